@@ -0,0 +1,287 @@
+// Бенчмарк масштабируемости программы squirrels.
+// Перебирает число процессов (1, 2, 4, ... до --max-np, с --oversubscribe) и размеры мешка,
+// каждую конфигурацию запускает --warmup раз вхолостую и --reps раз с замером (--profile-out),
+// берёт медиану и считает пропускную способность по фазам и параллельную эффективность.
+//   strong - мешок фиксирован, эффективность T(1) / (np * T(np))
+//   weak   - на процесс приходится фиксированный кусок мешка, эффективность T(1) / T(np)
+// Результаты пишутся в CSV (и JSON), и их можно сравнить с сохранённым эталоном:
+// если конфигурация стала медленнее эталона больше чем на --tolerance, бенчмарк возвращает 1.
+//
+// Сборка и запуск (рядом должен лежать собранный ./squirrels):
+//   g++ -std=c++17 -O2 bench_scaling.cpp -o bench_scaling
+//   ./bench_scaling --max-np 8 --sizes 1000000,10000000 --reps 3 --out bench_scaling.csv
+//   ./bench_scaling ... --baseline bench_baseline.csv --tolerance 0.25
+// Для мешков 10^8..10^9 лучше добавить --args "--gen philox --dist local", чтобы не упереться в память root.
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+static const char* PROFILE_FILE = "bench_profile.json"; // отчёт одного запуска
+static const char* OUTPUT_FILE  = "bench_run.txt";      // вывод одного запуска
+
+struct BenchOptions {
+    int max_np = 8;
+    std::vector<long long> sizes = { 1000000, 10000000 };
+    int reps = 3;
+    int warmup = 1;
+    std::string mode = "both";   // strong, weak или both
+    std::string args;            // дополнительные параметры squirrels
+    std::string mpirun = "mpirun --oversubscribe -np ";
+    std::string out = "bench_scaling.csv";
+    std::string json;
+    std::string baseline;
+    double tolerance = 0.25;
+};
+
+// Результат одной конфигурации (медианы по повторам)
+struct BenchResult {
+    std::string mode;
+    int np = 0;
+    long long nuts = 0;
+    double total = 0.0;
+    std::map<std::string, double> phases; // максимум по процессам
+    long long bytes_scattered = 0;
+    double imbalance_compute = 0.0;
+    double nuts_per_s = 0.0;
+    double scatter_gb_s = 0.0;
+    double efficiency = 0.0;
+};
+
+const char* const PHASES[] = { "generate", "read", "partition", "scatter", "compute", "exchange", "trade", "stream", "output" };
+
+// Достаём из отчёта поле "max" объекта "key": {...}
+double json_max(const std::string& json, const std::string& key) {
+    std::size_t pos = json.find("\"" + key + "\": {");
+    if (pos == std::string::npos) throw std::runtime_error("в отчёте нет " + key);
+    pos = json.find("\"max\": ", pos);
+    return std::stod(json.substr(pos + 7));
+}
+
+// Достаём из отчёта числовое поле "key": value, первое после позиции from
+double json_number(const std::string& json, const std::string& key, std::size_t from = 0) {
+    std::size_t pos = json.find("\"" + key + "\": ", from);
+    if (pos == std::string::npos) throw std::runtime_error("в отчёте нет " + key);
+    return std::stod(json.substr(pos + key.size() + 4));
+}
+
+double median(std::vector<double> v) {
+    std::sort(v.begin(), v.end());
+    std::size_t n = v.size();
+    return n % 2 ? v[n / 2] : 0.5 * (v[n / 2 - 1] + v[n / 2]);
+}
+
+// Один запуск squirrels; возвращает текст отчёта --profile
+std::string run_once(const BenchOptions& opt, int np, long long nuts) {
+    std::ostringstream cmd;
+    int squirrels = std::max(100, np);
+    cmd << opt.mpirun << np << " ./squirrels --output summary --squirrels " << squirrels
+        << " --nuts " << nuts << " --profile-out " << PROFILE_FILE << " " << opt.args
+        << " > " << OUTPUT_FILE << " 2>&1";
+    if (std::system(cmd.str().c_str()) != 0) {
+        throw std::runtime_error("запуск завершился с ошибкой: " + cmd.str());
+    }
+    std::ifstream fin(PROFILE_FILE);
+    return std::string((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+}
+
+BenchResult run_config(const BenchOptions& opt, const std::string& mode, int np, long long nuts) {
+    for (int w = 0; w < opt.warmup; ++w) run_once(opt, np, nuts);
+
+    std::vector<double> totals, imbalances;
+    std::map<std::string, std::vector<double>> phases;
+    BenchResult r;
+    for (int k = 0; k < opt.reps; ++k) {
+        std::string json = run_once(opt, np, nuts);
+        totals.push_back(json_max(json, "total"));
+        for (const char* p : PHASES) phases[p].push_back(json_max(json, p));
+        imbalances.push_back(json_number(json, "compute", json.find("\"imbalance\"")));
+        r.bytes_scattered = static_cast<long long>(json_number(json, "bytes_scattered"));
+    }
+    r.mode = mode;
+    r.np = np;
+    r.nuts = nuts;
+    r.total = median(totals);
+    for (auto& kv : phases) r.phases[kv.first] = median(kv.second);
+    r.imbalance_compute = median(imbalances);
+    r.nuts_per_s = r.total > 0.0 ? nuts / r.total : 0.0;
+    double scatter = r.phases["scatter"];
+    r.scatter_gb_s = scatter > 0.0 ? r.bytes_scattered / scatter / 1e9 : 0.0;
+    return r;
+}
+
+// Эталон: ключ "mode,np,nuts" -> total
+std::map<std::string, double> load_baseline(const std::string& path) {
+    std::map<std::string, double> base;
+    std::ifstream fin(path);
+    if (!fin.is_open()) throw std::runtime_error("не удалось открыть эталон " + path);
+    std::string line;
+    std::getline(fin, line); // заголовок
+    while (std::getline(fin, line)) {
+        std::vector<std::string> cols;
+        std::stringstream ss(line);
+        std::string col;
+        while (std::getline(ss, col, ',')) cols.push_back(col);
+        if (cols.size() < 4) continue;
+        base[cols[0] + "," + cols[1] + "," + cols[2]] = std::stod(cols[3]);
+    }
+    return base;
+}
+
+bool parse_bench_options(int argc, char** argv, BenchOptions& opt) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Ошибка: нет значения для параметра " << arg << "\n";
+            return false;
+        }
+        std::string val = argv[++i];
+        if (arg == "--max-np") {
+            opt.max_np = std::stoi(val);
+        } else if (arg == "--sizes") {
+            opt.sizes.clear();
+            std::stringstream ss(val);
+            std::string item;
+            while (std::getline(ss, item, ',')) opt.sizes.push_back(static_cast<long long>(std::stod(item)));
+        } else if (arg == "--reps") {
+            opt.reps = std::stoi(val);
+        } else if (arg == "--warmup") {
+            opt.warmup = std::stoi(val);
+        } else if (arg == "--mode") {
+            opt.mode = val;
+        } else if (arg == "--args") {
+            opt.args = val;
+        } else if (arg == "--mpirun") {
+            opt.mpirun = val + " ";
+        } else if (arg == "--out") {
+            opt.out = val;
+        } else if (arg == "--json") {
+            opt.json = val;
+        } else if (arg == "--baseline") {
+            opt.baseline = val;
+        } else if (arg == "--tolerance") {
+            opt.tolerance = std::stod(val);
+        } else {
+            std::cerr << "Ошибка: неизвестный параметр " << arg << "\n";
+            return false;
+        }
+    }
+    if (opt.mode != "strong" && opt.mode != "weak" && opt.mode != "both") {
+        std::cerr << "Ошибка: --mode должен быть strong, weak или both\n";
+        return false;
+    }
+    if (opt.max_np < 1 || opt.reps < 1) {
+        std::cerr << "Ошибка: --max-np и --reps должны быть не меньше 1\n";
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    BenchOptions opt;
+    try {
+        if (!parse_bench_options(argc, argv, opt)) return 1;
+    } catch (const std::exception&) {
+        std::cerr << "Ошибка: некорректное числовое значение параметра\n";
+        return 1;
+    }
+
+    std::vector<int> nps;
+    for (int np = 1; np < opt.max_np; np *= 2) nps.push_back(np);
+    nps.push_back(opt.max_np);
+
+    std::vector<std::string> modes;
+    if (opt.mode != "weak") modes.push_back("strong");
+    if (opt.mode != "strong") modes.push_back("weak");
+
+    std::vector<BenchResult> results;
+    try {
+        for (const auto& mode : modes) {
+            for (long long size : opt.sizes) {
+                double t1 = 0.0;
+                for (int np : nps) {
+                    // в weak size - кусок на процесс
+                    long long nuts = (mode == "weak") ? size * np : size;
+                    BenchResult r = run_config(opt, mode, np, nuts);
+                    if (np == 1) t1 = r.total;
+                    if (r.total > 0.0) {
+                        r.efficiency = (mode == "strong") ? t1 / (np * r.total) : t1 / r.total;
+                    }
+                    std::cout << std::fixed << std::setprecision(4)
+                              << mode << " np=" << np << " nuts=" << nuts
+                              << " total=" << r.total << "s"
+                              << " nuts/s=" << std::scientific << std::setprecision(3) << r.nuts_per_s
+                              << std::fixed << std::setprecision(3)
+                              << " scatter=" << r.scatter_gb_s << "GB/s"
+                              << " eff=" << r.efficiency << std::endl;
+                    results.push_back(r);
+                }
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Ошибка бенчмарка: " << e.what() << "\n";
+        return 1;
+    }
+
+    // CSV
+    std::ofstream csv(opt.out);
+    csv << "mode,np,nuts,total_s";
+    for (const char* p : PHASES) csv << "," << p << "_s";
+    csv << ",nuts_per_s,scatter_gb_s,efficiency,imbalance_compute\n";
+    csv << std::setprecision(9);
+    for (const auto& r : results) {
+        csv << r.mode << "," << r.np << "," << r.nuts << "," << r.total;
+        for (const char* p : PHASES) csv << "," << r.phases.at(p);
+        csv << "," << r.nuts_per_s << "," << r.scatter_gb_s << "," << r.efficiency << "," << r.imbalance_compute << "\n";
+    }
+
+    // JSON
+    if (!opt.json.empty()) {
+        std::ofstream js(opt.json);
+        js << std::setprecision(9) << "[\n";
+        for (std::size_t i = 0; i < results.size(); ++i) {
+            const auto& r = results[i];
+            js << "  {\"mode\": \"" << r.mode << "\", \"np\": " << r.np << ", \"nuts\": " << r.nuts
+               << ", \"total_s\": " << r.total << ", \"phases_s\": {";
+            for (std::size_t k = 0; k < sizeof(PHASES) / sizeof(PHASES[0]); ++k) {
+                js << (k ? ", " : "") << "\"" << PHASES[k] << "\": " << r.phases.at(PHASES[k]);
+            }
+            js << "}, \"nuts_per_s\": " << r.nuts_per_s << ", \"scatter_gb_s\": " << r.scatter_gb_s
+               << ", \"efficiency\": " << r.efficiency << ", \"imbalance_compute\": " << r.imbalance_compute
+               << "}" << (i + 1 < results.size() ? ",\n" : "\n");
+        }
+        js << "]\n";
+    }
+
+    // Сравнение с эталоном
+    if (!opt.baseline.empty()) {
+        int regressions = 0;
+        try {
+            auto base = load_baseline(opt.baseline);
+            for (const auto& r : results) {
+                std::string key = r.mode + "," + std::to_string(r.np) + "," + std::to_string(r.nuts);
+                auto it = base.find(key);
+                if (it == base.end() || it->second <= 0.0) continue;
+                double ratio = r.total / it->second;
+                if (ratio > 1.0 + opt.tolerance) {
+                    std::cerr << "[REGRESSION] " << key << ": " << r.total << "s против " << it->second
+                              << "s в эталоне (x" << ratio << ")\n";
+                    ++regressions;
+                }
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Ошибка: " << e.what() << "\n";
+            return 1;
+        }
+        std::cout << "Регрессий относительно эталона: " << regressions << "\n";
+        if (regressions > 0) return 1;
+    }
+    return 0;
+}
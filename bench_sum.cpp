@@ -0,0 +1,47 @@
+// Микробенчмарк ядер суммирования из nut_sum.hpp против std::accumulate.
+// Для каждого размера куска печатает время на орех, пропускную способность
+// и относительную ошибку суммы относительно эталона в long double.
+//
+// Сборка и запуск:
+//   g++ -std=c++17 -O2 bench_sum.cpp -o bench_sum
+//   ./bench_sum [макс. размер куска]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "nut_rng.hpp"
+#include "nut_sum.hpp"
+
+int main(int argc, char** argv) {
+    std::size_t max_n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 100000000ULL;
+    const char* kernels[] = { "naive", "simd", "kahan", "pairwise" };
+
+    std::vector<double> nuts(max_n);
+    philox_fill_nuts(42, 0, nuts.data(), nuts.size(), 0.1, 10.0);
+
+    std::printf("isa: %s\n", nut_sum_isa());
+    std::printf("%-10s %12s %10s %10s %12s\n", "kernel", "n", "ns/nut", "GB/s", "rel.error");
+    for (std::size_t n = 1000; n <= max_n; n *= 10) {
+        long double ref = nut_sum_reference(nuts.data(), n);
+        // повторяем, пока не наберём ~10^8 орехов, чтобы маленькие размеры тоже мерились устойчиво
+        std::size_t reps = std::max<std::size_t>(1, 100000000ULL / n);
+        for (const char* name : kernels) {
+            nut_sum_fn fn = nut_sum_kernel(name);
+            volatile double sink = fn(nuts.data(), n); // разогрев
+            auto t0 = std::chrono::steady_clock::now();
+            for (std::size_t r = 0; r < reps; ++r) sink = fn(nuts.data(), n);
+            auto t1 = std::chrono::steady_clock::now();
+            double sec = std::chrono::duration<double>(t1 - t0).count();
+            double per_nut = sec / (static_cast<double>(n) * reps);
+            double rel_err = static_cast<double>(std::fabs((static_cast<long double>(sink) - ref) / ref));
+            std::printf("%-10s %12zu %10.3f %10.2f %12.3e\n", name, n, per_nut * 1e9,
+                        sizeof(double) / per_nut / 1e9, rel_err);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+// Сводка задержек для --profile (время раунда обмена, задержка обновления в потоковом режиме):
+// гистограмма из LATENCY_HIST_BINS корзин, равных в логарифмическом масштабе - по
+// LATENCY_HIST_PER_OCTAVE на каждое удвоение, от 2^LATENCY_HIST_MIN_EXP с (~1 нс) до ~1000 с,
+// плюс число, сумма, наименьшее и наибольшее значение. Весит ~2.5 КБ, сколько бы ни было
+// раундов или обновлений, поэтому память и редукция на root не растут со временем работы.
+// Слияние - сложение корзин, как у NutSketch, так что сводки процессов сворачиваются в MPI_Reduce.
+//
+// min, max и mean точные. Квантиль - середина корзины (в логарифмическом масштабе), куда
+// попало значение этого ранга: относительная ошибка не больше 2^(1/16) - 1 ≈ 4.4%.
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+const int LATENCY_HIST_PER_OCTAVE = 8;
+const int LATENCY_HIST_MIN_EXP = -30;
+const int LATENCY_HIST_BINS = 40 * LATENCY_HIST_PER_OCTAVE; // 2^-30 .. 2^10 с
+
+struct LatencyHist {
+    long long count = 0;
+    double sum = 0.0;
+    double min = std::numeric_limits<double>::infinity();
+    double max = -std::numeric_limits<double>::infinity();
+    long long bins[LATENCY_HIST_BINS] = {};
+};
+
+// Добавляем одно время t в секундах; значения вне диапазона попадают в крайние корзины
+inline void latency_hist_add(LatencyHist& h, double t) {
+    int b = 0;
+    if (t > 0.0) {
+        double pos = (std::log2(t) - LATENCY_HIST_MIN_EXP) * LATENCY_HIST_PER_OCTAVE;
+        b = static_cast<int>(std::min(std::max(pos, 0.0), LATENCY_HIST_BINS - 1.0));
+    }
+    h.bins[b] += 1;
+    h.count += 1;
+    h.sum += t;
+    h.min = std::min(h.min, t);
+    h.max = std::max(h.max, t);
+}
+
+// inout += in
+inline void latency_hist_merge(const LatencyHist& in, LatencyHist& inout) {
+    inout.count += in.count;
+    inout.sum += in.sum;
+    inout.min = std::min(inout.min, in.min);
+    inout.max = std::max(inout.max, in.max);
+    for (int b = 0; b < LATENCY_HIST_BINS; ++b) inout.bins[b] += in.bins[b];
+}
+
+// Квантиль q из [0, 1]: значение номер q * count по возрастанию; у пустой сводки - 0
+inline double latency_hist_quantile(const LatencyHist& h, double q) {
+    if (h.count == 0) return 0.0;
+    long long k = std::min(h.count - 1, static_cast<long long>(q * static_cast<double>(h.count)));
+    long long before = 0;
+    int b = 0;
+    while (b + 1 < LATENCY_HIST_BINS && before + h.bins[b] <= k) before += h.bins[b++];
+    double x = std::exp2(LATENCY_HIST_MIN_EXP + (b + 0.5) / LATENCY_HIST_PER_OCTAVE);
+    return std::min(std::max(x, h.min), h.max);
+}
@@ -0,0 +1,94 @@
+// Генератор файла мешка орехов (формат описан в nut_bag.hpp).
+// Массы берутся из тех же генераторов, что и в squirrels.cpp, поэтому
+// make_bag --rng philox + squirrels --input даёт тот же результат, что squirrels --gen philox.
+//
+// Сборка и запуск:
+//   g++ -std=c++17 -O2 make_bag.cpp -o make_bag
+//   ./make_bag bag.bin [--nuts N] [--seed S] [--rng mt19937|philox] [--dtype f64|f32]
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "nut_bag.hpp"
+#include "nut_rng.hpp"
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Использование: " << argv[0]
+                  << " файл [--nuts N] [--seed S] [--rng mt19937|philox] [--dtype f64|f32]\n";
+        return 1;
+    }
+    std::string path = argv[1];
+    unsigned long long total_nuts = 1000298;
+    unsigned long long seed = 42;
+    std::string rng = "philox";
+    std::string dtype = "f64";
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Ошибка: нет значения для параметра " << arg << "\n";
+            return 1;
+        }
+        std::string val = argv[++i];
+        if (arg == "--nuts") {
+            total_nuts = std::stoull(val);
+        } else if (arg == "--seed") {
+            seed = std::stoull(val);
+        } else if (arg == "--rng") {
+            rng = val;
+        } else if (arg == "--dtype") {
+            dtype = val;
+        } else {
+            std::cerr << "Ошибка: неизвестный параметр " << arg << "\n";
+            return 1;
+        }
+    }
+    if ((rng != "mt19937" && rng != "philox") || (dtype != "f64" && dtype != "f32")) {
+        std::cerr << "Ошибка: --rng должен быть mt19937 или philox, --dtype - f64 или f32\n";
+        return 1;
+    }
+
+    std::FILE* f = std::fopen(path.c_str(), "wb");
+    if (!f) {
+        std::cerr << "Ошибка: не удалось создать файл " << path << "\n";
+        return 1;
+    }
+    NutBagHeader header;
+    header.dtype = (dtype == "f32") ? NUT_BAG_F32 : NUT_BAG_F64;
+    header.count = total_nuts;
+    std::fwrite(&header, sizeof(header), 1, f);
+
+    // Пишем блоками, чтобы не держать весь мешок в памяти
+    const std::size_t BLOCK = 1 << 20;
+    std::vector<double> block(BLOCK);
+    std::vector<float> block_f32(BLOCK);
+    std::mt19937 gen(static_cast<std::mt19937::result_type>(seed));
+    std::uniform_real_distribution<double> dist(NUT_MASS_MIN, NUT_MASS_MAX);
+    for (unsigned long long first = 0; first < total_nuts; first += BLOCK) {
+        std::size_t n = static_cast<std::size_t>(std::min<unsigned long long>(BLOCK, total_nuts - first));
+        if (rng == "philox") {
+            philox_fill_nuts(seed, first, block.data(), n, NUT_MASS_MIN, NUT_MASS_MAX);
+        } else {
+            for (std::size_t i = 0; i < n; ++i) block[i] = dist(gen);
+        }
+        bool ok;
+        if (header.dtype == NUT_BAG_F32) {
+            for (std::size_t i = 0; i < n; ++i) block_f32[i] = static_cast<float>(block[i]);
+            ok = std::fwrite(block_f32.data(), sizeof(float), n, f) == n;
+        } else {
+            ok = std::fwrite(block.data(), sizeof(double), n, f) == n;
+        }
+        if (!ok) {
+            std::cerr << "Ошибка записи в " << path << "\n";
+            std::fclose(f);
+            return 1;
+        }
+    }
+    std::fclose(f);
+    std::cout << "Записано " << total_nuts << " орехов (" << dtype << ", " << rng << ") в " << path << "\n";
+    return 0;
+}
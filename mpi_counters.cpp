@@ -0,0 +1,322 @@
+// Слой PMPI: считает вызовы и байты для MPI-функций, которые использует squirrels.cpp,
+// не меняя код симуляции. Подключается только при сборке:
+//   mpic++ -O2 -fopenmp -o squirrels_counted main.cpp squirrels.cpp mpi_counters.cpp
+// Каждая функция MPI_X здесь считает статистику и вызывает настоящую PMPI_X.
+// При MPI_Finalize счётчики всех процессов суммируются на процессе 0
+// и печатаются в stderr таблицей: вызовы, отправлено и получено байт всего
+// и наибольшие значения на одном процессе.
+//
+// Байты считаются по буферам этого процесса: для коллективов root учитывает
+// всё, что рассылает/собирает, остальные - свою часть.
+// Постоянные запросы (MPI_Send_init / MPI_Recv_init) запоминают свои байты, а считаются
+// они при каждом MPI_Start / MPI_Startall. У MPI_Win_allocate_shared в bytes_recv - размер
+// части окна, выделенной процессу; у MPI_Iprobe и MPI_Comm_split* - только вызовы.
+// Варианты MPI-4 с большими счётчиками (MPI_Scatterv_c, MPI_Iscatterv_c) - отдельные строки.
+
+#include <mpi.h>
+#include <cstdio>
+#include <map>
+#include <utility>
+
+namespace {
+
+enum Routine {
+    R_BCAST, R_SCATTER, R_SCATTERV, R_ISCATTERV, R_GATHER, R_GATHERV,
+    R_ALLGATHER, R_ALLGATHERV, R_REDUCE, R_ALLREDUCE, R_SEND, R_RECV,
+    R_ISEND, R_IRECV, R_SENDRECV, R_NEIGHBOR_ALLTOALL, R_NEIGHBOR_ALLGATHER,
+    R_FILE_READ_AT_ALL, R_FILE_WRITE_AT_ALL, R_SCATTERV_C, R_ISCATTERV_C, R_EXSCAN,
+    R_IALLREDUCE, R_SEND_INIT, R_RECV_INIT, R_START, R_IPROBE, R_FILE_READ_AT, R_FILE_WRITE_AT,
+    R_WIN_ALLOCATE_SHARED, R_COMM_SPLIT, R_COMM_SPLIT_TYPE, R_COUNT
+};
+
+const char* const ROUTINE_NAMES[R_COUNT] = {
+    "MPI_Bcast", "MPI_Scatter", "MPI_Scatterv", "MPI_Iscatterv", "MPI_Gather", "MPI_Gatherv",
+    "MPI_Allgather", "MPI_Allgatherv", "MPI_Reduce", "MPI_Allreduce", "MPI_Send", "MPI_Recv",
+    "MPI_Isend", "MPI_Irecv", "MPI_Sendrecv", "MPI_Neighbor_alltoall", "MPI_Neighbor_allgather",
+    "MPI_File_read_at_all", "MPI_File_write_at_all", "MPI_Scatterv_c", "MPI_Iscatterv_c", "MPI_Exscan",
+    "MPI_Iallreduce", "MPI_Send_init", "MPI_Recv_init", "MPI_Start", "MPI_Iprobe", "MPI_File_read_at",
+    "MPI_File_write_at", "MPI_Win_allocate_shared", "MPI_Comm_split", "MPI_Comm_split_type"
+};
+
+// вызовы, отправлено байт, получено байт
+long long counters[R_COUNT][3];
+
+// байты постоянных запросов: отправляемые и принимаемые за один запуск
+std::map<MPI_Request, std::pair<long long, long long>> persistent;
+
+long long type_bytes(MPI_Datatype type, long long count) {
+    int size = 0;
+    PMPI_Type_size(type, &size);
+    return static_cast<long long>(size) * count;
+}
+
+long long sum_counts(const int* counts, int n) {
+    long long sum = 0;
+    for (int i = 0; i < n; ++i) sum += counts[i];
+    return sum;
+}
+
+#if MPI_VERSION >= 4
+long long sum_counts(const MPI_Count* counts, int n) {
+    long long sum = 0;
+    for (int i = 0; i < n; ++i) sum += static_cast<long long>(counts[i]);
+    return sum;
+}
+#endif
+
+int comm_size(MPI_Comm comm) {
+    int size = 0;
+    PMPI_Comm_size(comm, &size);
+    return size;
+}
+
+bool is_root(int root, MPI_Comm comm) {
+    int rank = 0;
+    PMPI_Comm_rank(comm, &rank);
+    return rank == root;
+}
+
+void count(Routine r, long long sent, long long received) {
+    counters[r][0] += 1;
+    counters[r][1] += sent;
+    counters[r][2] += received;
+}
+
+// Запуск постоянного запроса: байты берём из MPI_Send_init / MPI_Recv_init
+void count_start(MPI_Request req) {
+    auto it = persistent.find(req);
+    if (it == persistent.end()) count(R_START, 0, 0);
+    else count(R_START, it->second.first, it->second.second);
+}
+
+} // namespace
+
+extern "C" {
+
+int MPI_Bcast(void* buf, int n, MPI_Datatype type, int root, MPI_Comm comm) {
+    long long bytes = type_bytes(type, n);
+    bool r = is_root(root, comm);
+    count(R_BCAST, r ? bytes : 0, r ? 0 : bytes);
+    return PMPI_Bcast(buf, n, type, root, comm);
+}
+
+int MPI_Scatter(const void* sbuf, int scount, MPI_Datatype stype, void* rbuf, int rcount,
+                MPI_Datatype rtype, int root, MPI_Comm comm) {
+    long long sent = is_root(root, comm) ? type_bytes(stype, static_cast<long long>(scount) * comm_size(comm)) : 0;
+    count(R_SCATTER, sent, type_bytes(rtype, rcount));
+    return PMPI_Scatter(sbuf, scount, stype, rbuf, rcount, rtype, root, comm);
+}
+
+int MPI_Scatterv(const void* sbuf, const int scounts[], const int displs[], MPI_Datatype stype,
+                 void* rbuf, int rcount, MPI_Datatype rtype, int root, MPI_Comm comm) {
+    long long sent = is_root(root, comm) ? type_bytes(stype, sum_counts(scounts, comm_size(comm))) : 0;
+    count(R_SCATTERV, sent, type_bytes(rtype, rcount));
+    return PMPI_Scatterv(sbuf, scounts, displs, stype, rbuf, rcount, rtype, root, comm);
+}
+
+int MPI_Iscatterv(const void* sbuf, const int scounts[], const int displs[], MPI_Datatype stype,
+                  void* rbuf, int rcount, MPI_Datatype rtype, int root, MPI_Comm comm, MPI_Request* req) {
+    long long sent = is_root(root, comm) ? type_bytes(stype, sum_counts(scounts, comm_size(comm))) : 0;
+    count(R_ISCATTERV, sent, type_bytes(rtype, rcount));
+    return PMPI_Iscatterv(sbuf, scounts, displs, stype, rbuf, rcount, rtype, root, comm, req);
+}
+
+#if MPI_VERSION >= 4
+int MPI_Scatterv_c(const void* sbuf, const MPI_Count scounts[], const MPI_Aint displs[], MPI_Datatype stype,
+                   void* rbuf, MPI_Count rcount, MPI_Datatype rtype, int root, MPI_Comm comm) {
+    long long sent = is_root(root, comm) ? type_bytes(stype, sum_counts(scounts, comm_size(comm))) : 0;
+    count(R_SCATTERV_C, sent, type_bytes(rtype, static_cast<long long>(rcount)));
+    return PMPI_Scatterv_c(sbuf, scounts, displs, stype, rbuf, rcount, rtype, root, comm);
+}
+
+int MPI_Iscatterv_c(const void* sbuf, const MPI_Count scounts[], const MPI_Aint displs[], MPI_Datatype stype,
+                    void* rbuf, MPI_Count rcount, MPI_Datatype rtype, int root, MPI_Comm comm, MPI_Request* req) {
+    long long sent = is_root(root, comm) ? type_bytes(stype, sum_counts(scounts, comm_size(comm))) : 0;
+    count(R_ISCATTERV_C, sent, type_bytes(rtype, static_cast<long long>(rcount)));
+    return PMPI_Iscatterv_c(sbuf, scounts, displs, stype, rbuf, rcount, rtype, root, comm, req);
+}
+#endif
+
+int MPI_Gather(const void* sbuf, int scount, MPI_Datatype stype, void* rbuf, int rcount,
+               MPI_Datatype rtype, int root, MPI_Comm comm) {
+    long long received = is_root(root, comm) ? type_bytes(rtype, static_cast<long long>(rcount) * comm_size(comm)) : 0;
+    count(R_GATHER, type_bytes(stype, scount), received);
+    return PMPI_Gather(sbuf, scount, stype, rbuf, rcount, rtype, root, comm);
+}
+
+int MPI_Gatherv(const void* sbuf, int scount, MPI_Datatype stype, void* rbuf, const int rcounts[],
+                const int displs[], MPI_Datatype rtype, int root, MPI_Comm comm) {
+    long long received = is_root(root, comm) ? type_bytes(rtype, sum_counts(rcounts, comm_size(comm))) : 0;
+    count(R_GATHERV, type_bytes(stype, scount), received);
+    return PMPI_Gatherv(sbuf, scount, stype, rbuf, rcounts, displs, rtype, root, comm);
+}
+
+int MPI_Allgather(const void* sbuf, int scount, MPI_Datatype stype, void* rbuf, int rcount,
+                  MPI_Datatype rtype, MPI_Comm comm) {
+    count(R_ALLGATHER, type_bytes(stype, scount), type_bytes(rtype, static_cast<long long>(rcount) * comm_size(comm)));
+    return PMPI_Allgather(sbuf, scount, stype, rbuf, rcount, rtype, comm);
+}
+
+int MPI_Allgatherv(const void* sbuf, int scount, MPI_Datatype stype, void* rbuf, const int rcounts[],
+                   const int displs[], MPI_Datatype rtype, MPI_Comm comm) {
+    count(R_ALLGATHERV, type_bytes(stype, scount), type_bytes(rtype, sum_counts(rcounts, comm_size(comm))));
+    return PMPI_Allgatherv(sbuf, scount, stype, rbuf, rcounts, displs, rtype, comm);
+}
+
+int MPI_Reduce(const void* sbuf, void* rbuf, int n, MPI_Datatype type, MPI_Op op, int root, MPI_Comm comm) {
+    long long bytes = type_bytes(type, n);
+    count(R_REDUCE, bytes, is_root(root, comm) ? bytes : 0);
+    return PMPI_Reduce(sbuf, rbuf, n, type, op, root, comm);
+}
+
+int MPI_Allreduce(const void* sbuf, void* rbuf, int n, MPI_Datatype type, MPI_Op op, MPI_Comm comm) {
+    long long bytes = type_bytes(type, n);
+    count(R_ALLREDUCE, bytes, bytes);
+    return PMPI_Allreduce(sbuf, rbuf, n, type, op, comm);
+}
+
+int MPI_Exscan(const void* sbuf, void* rbuf, int n, MPI_Datatype type, MPI_Op op, MPI_Comm comm) {
+    long long bytes = type_bytes(type, n);
+    // у процесса 0 результат не определён - он ничего не получает
+    count(R_EXSCAN, bytes, is_root(0, comm) ? 0 : bytes);
+    return PMPI_Exscan(sbuf, rbuf, n, type, op, comm);
+}
+
+int MPI_Iallreduce(const void* sbuf, void* rbuf, int n, MPI_Datatype type, MPI_Op op, MPI_Comm comm,
+                   MPI_Request* req) {
+    long long bytes = type_bytes(type, n);
+    count(R_IALLREDUCE, bytes, bytes);
+    return PMPI_Iallreduce(sbuf, rbuf, n, type, op, comm, req);
+}
+
+int MPI_Send(const void* buf, int n, MPI_Datatype type, int dest, int tag, MPI_Comm comm) {
+    count(R_SEND, type_bytes(type, n), 0);
+    return PMPI_Send(buf, n, type, dest, tag, comm);
+}
+
+int MPI_Recv(void* buf, int n, MPI_Datatype type, int src, int tag, MPI_Comm comm, MPI_Status* status) {
+    count(R_RECV, 0, type_bytes(type, n));
+    return PMPI_Recv(buf, n, type, src, tag, comm, status);
+}
+
+int MPI_Isend(const void* buf, int n, MPI_Datatype type, int dest, int tag, MPI_Comm comm, MPI_Request* req) {
+    count(R_ISEND, type_bytes(type, n), 0);
+    return PMPI_Isend(buf, n, type, dest, tag, comm, req);
+}
+
+int MPI_Irecv(void* buf, int n, MPI_Datatype type, int src, int tag, MPI_Comm comm, MPI_Request* req) {
+    count(R_IRECV, 0, type_bytes(type, n));
+    return PMPI_Irecv(buf, n, type, src, tag, comm, req);
+}
+
+int MPI_Send_init(const void* buf, int n, MPI_Datatype type, int dest, int tag, MPI_Comm comm, MPI_Request* req) {
+    count(R_SEND_INIT, 0, 0);
+    int err = PMPI_Send_init(buf, n, type, dest, tag, comm, req);
+    persistent[*req] = { type_bytes(type, n), 0 };
+    return err;
+}
+
+int MPI_Recv_init(void* buf, int n, MPI_Datatype type, int src, int tag, MPI_Comm comm, MPI_Request* req) {
+    count(R_RECV_INIT, 0, 0);
+    int err = PMPI_Recv_init(buf, n, type, src, tag, comm, req);
+    persistent[*req] = { 0, type_bytes(type, n) };
+    return err;
+}
+
+int MPI_Start(MPI_Request* req) {
+    count_start(*req);
+    return PMPI_Start(req);
+}
+
+int MPI_Startall(int n, MPI_Request reqs[]) {
+    for (int i = 0; i < n; ++i) count_start(reqs[i]);
+    return PMPI_Startall(n, reqs);
+}
+
+int MPI_Request_free(MPI_Request* req) {
+    persistent.erase(*req);
+    return PMPI_Request_free(req);
+}
+
+int MPI_Iprobe(int src, int tag, MPI_Comm comm, int* flag, MPI_Status* status) {
+    count(R_IPROBE, 0, 0);
+    return PMPI_Iprobe(src, tag, comm, flag, status);
+}
+
+int MPI_Sendrecv(const void* sbuf, int scount, MPI_Datatype stype, int dest, int stag,
+                 void* rbuf, int rcount, MPI_Datatype rtype, int src, int rtag,
+                 MPI_Comm comm, MPI_Status* status) {
+    count(R_SENDRECV, type_bytes(stype, scount), type_bytes(rtype, rcount));
+    return PMPI_Sendrecv(sbuf, scount, stype, dest, stag, rbuf, rcount, rtype, src, rtag, comm, status);
+}
+
+int MPI_Neighbor_alltoall(const void* sbuf, int scount, MPI_Datatype stype, void* rbuf, int rcount,
+                          MPI_Datatype rtype, MPI_Comm comm) {
+    // в одномерной периодической топологии у процесса два соседа
+    count(R_NEIGHBOR_ALLTOALL, type_bytes(stype, 2LL * scount), type_bytes(rtype, 2LL * rcount));
+    return PMPI_Neighbor_alltoall(sbuf, scount, stype, rbuf, rcount, rtype, comm);
+}
+
+int MPI_Neighbor_allgather(const void* sbuf, int scount, MPI_Datatype stype, void* rbuf, int rcount,
+                           MPI_Datatype rtype, MPI_Comm comm) {
+    count(R_NEIGHBOR_ALLGATHER, type_bytes(stype, 2LL * scount), type_bytes(rtype, 2LL * rcount));
+    return PMPI_Neighbor_allgather(sbuf, scount, stype, rbuf, rcount, rtype, comm);
+}
+
+int MPI_File_read_at(MPI_File fh, MPI_Offset offset, void* buf, int n, MPI_Datatype type, MPI_Status* status) {
+    count(R_FILE_READ_AT, 0, type_bytes(type, n));
+    return PMPI_File_read_at(fh, offset, buf, n, type, status);
+}
+
+int MPI_File_write_at(MPI_File fh, MPI_Offset offset, const void* buf, int n, MPI_Datatype type, MPI_Status* status) {
+    count(R_FILE_WRITE_AT, type_bytes(type, n), 0);
+    return PMPI_File_write_at(fh, offset, buf, n, type, status);
+}
+
+int MPI_File_read_at_all(MPI_File fh, MPI_Offset offset, void* buf, int n, MPI_Datatype type, MPI_Status* status) {
+    count(R_FILE_READ_AT_ALL, 0, type_bytes(type, n));
+    return PMPI_File_read_at_all(fh, offset, buf, n, type, status);
+}
+
+int MPI_File_write_at_all(MPI_File fh, MPI_Offset offset, const void* buf, int n, MPI_Datatype type,
+                          MPI_Status* status) {
+    count(R_FILE_WRITE_AT_ALL, type_bytes(type, n), 0);
+    return PMPI_File_write_at_all(fh, offset, buf, n, type, status);
+}
+
+int MPI_Win_allocate_shared(MPI_Aint size, int disp_unit, MPI_Info info, MPI_Comm comm, void* baseptr,
+                            MPI_Win* win) {
+    count(R_WIN_ALLOCATE_SHARED, 0, static_cast<long long>(size));
+    return PMPI_Win_allocate_shared(size, disp_unit, info, comm, baseptr, win);
+}
+
+int MPI_Comm_split(MPI_Comm comm, int color, int key, MPI_Comm* newcomm) {
+    count(R_COMM_SPLIT, 0, 0);
+    return PMPI_Comm_split(comm, color, key, newcomm);
+}
+
+int MPI_Comm_split_type(MPI_Comm comm, int split_type, int key, MPI_Info info, MPI_Comm* newcomm) {
+    count(R_COMM_SPLIT_TYPE, 0, 0);
+    return PMPI_Comm_split_type(comm, split_type, key, info, newcomm);
+}
+
+int MPI_Finalize(void) {
+    int rank = 0;
+    PMPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    long long totals[R_COUNT][3];
+    long long maxs[R_COUNT][3];
+    PMPI_Reduce(counters, totals, R_COUNT * 3, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    PMPI_Reduce(counters, maxs, R_COUNT * 3, MPI_LONG_LONG, MPI_MAX, 0, MPI_COMM_WORLD);
+    if (rank == 0) {
+        std::fprintf(stderr, "%-24s %10s %16s %16s %16s %16s\n",
+                     "routine", "calls", "bytes_sent", "bytes_recv", "max_rank_sent", "max_rank_recv");
+        for (int r = 0; r < R_COUNT; ++r) {
+            if (totals[r][0] == 0) continue;
+            std::fprintf(stderr, "%-24s %10lld %16lld %16lld %16lld %16lld\n", ROUTINE_NAMES[r],
+                         totals[r][0], totals[r][1], totals[r][2], maxs[r][1], maxs[r][2]);
+        }
+    }
+    return PMPI_Finalize();
+}
+
+} // extern "C"
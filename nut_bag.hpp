@@ -0,0 +1,63 @@
+#pragma once
+
+// Двоичный формат мешка орехов (.bag):
+//   заголовок 24 байта: "NUTS", версия (uint32), тип масс (uint32), резерв (uint32), число орехов (uint64)
+//   затем подряд массы орехов: float64 или float32, little-endian.
+// Кусок [first, first + n) лежит в файле по смещению NUT_BAG_HEADER_SIZE + first * размер массы,
+// поэтому каждая белка может прочитать свой кусок сама, не трогая остальные.
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+const std::uint32_t NUT_BAG_VERSION = 1;
+const std::uint32_t NUT_BAG_F64 = 1; // массы в double
+const std::uint32_t NUT_BAG_F32 = 2; // массы в float
+
+struct NutBagHeader {
+    char magic[4] = { 'N', 'U', 'T', 'S' };
+    std::uint32_t version = NUT_BAG_VERSION;
+    std::uint32_t dtype = NUT_BAG_F64;
+    std::uint32_t reserved = 0;
+    std::uint64_t count = 0;
+};
+
+static_assert(sizeof(NutBagHeader) == 24, "заголовок мешка должен занимать 24 байта");
+
+const std::uint64_t NUT_BAG_HEADER_SIZE = sizeof(NutBagHeader);
+
+// Размер одной массы в байтах
+inline std::uint64_t nut_bag_elem_size(std::uint32_t dtype) {
+    return dtype == NUT_BAG_F32 ? sizeof(float) : sizeof(double);
+}
+
+// Читаем и проверяем заголовок; при ошибке возвращаем false и текст ошибки в err
+inline bool read_nut_bag_header(const std::string& path, NutBagHeader& header, std::string& err) {
+    std::ifstream fin(path, std::ios::binary);
+    if (!fin.is_open()) {
+        err = "не удалось открыть файл мешка " + path;
+        return false;
+    }
+    fin.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!fin) {
+        err = "файл мешка " + path + " короче заголовка";
+        return false;
+    }
+    if (std::memcmp(header.magic, "NUTS", 4) != 0 || header.version != NUT_BAG_VERSION) {
+        err = "файл " + path + " - не мешок орехов (неверная сигнатура или версия)";
+        return false;
+    }
+    if (header.dtype != NUT_BAG_F64 && header.dtype != NUT_BAG_F32) {
+        err = "неизвестный тип масс в файле мешка " + path;
+        return false;
+    }
+    fin.seekg(0, std::ios::end);
+    std::uint64_t file_size = static_cast<std::uint64_t>(fin.tellg());
+    // делим, а не умножаем: count из чужого файла может быть любым, и произведение переполнится
+    if (header.count > (file_size - NUT_BAG_HEADER_SIZE) / nut_bag_elem_size(header.dtype)) {
+        err = "файл мешка " + path + " обрезан: орехов меньше, чем указано в заголовке";
+        return false;
+    }
+    return true;
+}
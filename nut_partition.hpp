@@ -0,0 +1,257 @@
+#pragma once
+
+// Разбиение мешка между белками (--partition): сколько орехов достаётся каждой белке.
+// Белки получают подряд идущие куски мешка, поэтому разбиение - это только вектор чисел.
+// Если орехов не меньше, чем белок, каждая белка получает хотя бы один орех.
+//
+//   random         - случайные разрезы (как в задании): куски сильно неравные,
+//                    и время до результата определяет самая нагруженная белка
+//   even           - поровну, куски отличаются не больше чем на 1
+//   bounded-random - случайные разрезы, но кусок не больше cap * среднего;
+//                    лишнее раздаётся белкам, у которых есть запас
+//   weighted       - пропорционально весам белок (производительности их процессов)
+//
+// Перекос разбиения - max / mean: 1 - идеально ровно, N - всё у одной белки.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "nut_rng.hpp"
+
+// Меньше орехов, чем белок: первые total белок получают по ореху, остальные - ничего
+inline bool partition_too_few(long long total, int n, std::vector<long long>& counts) {
+    if (total >= n) return false;
+    for (int i = 0; i < n; ++i) counts[i] = (i < total ? 1 : 0);
+    return true;
+}
+
+// Случайные разрезы: n - 1 точка из [0, total - n], куски между ними плюс по ореху каждой белке
+inline void partition_random(long long total, int n, std::mt19937& gen, std::vector<long long>& counts) {
+    counts.assign(n, 0);
+    if (partition_too_few(total, n, counts)) return;
+    long long base_each = 1; // минимум 1
+    long long remaining = total - static_cast<long long>(n);
+
+    std::uniform_int_distribution<long long> cut_dist(0, remaining);
+    std::vector<long long> cuts;
+    cuts.reserve(n - 1);
+    for (int i = 0; i < n - 1; ++i) cuts.push_back(cut_dist(gen));
+    std::sort(cuts.begin(), cuts.end());
+
+    // Разбиваем remaining на части по разрезам
+    long long prev = 0;
+    for (int r = 0; r < n - 1; ++r) {
+        counts[r] = base_each + (cuts[r] - prev);
+        prev = cuts[r];
+    }
+    // последний кусок
+    counts[n - 1] = base_each + (remaining - prev);
+}
+
+// Поровну: первые total % n белок получают на орех больше
+inline void partition_even(long long total, int n, std::vector<long long>& counts) {
+    counts.assign(n, 0);
+    for (int i = 0; i < n; ++i) counts[i] = total / n + (i < total % n ? 1 : 0);
+}
+
+// Случайные разрезы с потолком ceil(cap * total / n) на белку (cap >= 1, иначе всё не поместится).
+// Лишнее сверх потолка раздаётся поровну белкам, у которых до потолка ещё есть место.
+inline void partition_bounded_random(long long total, int n, double cap, std::mt19937& gen,
+                                     std::vector<long long>& counts) {
+    partition_random(total, n, gen, counts);
+    if (total < n) return;
+    long long limit = static_cast<long long>(std::ceil(cap * static_cast<double>(total) / n));
+    limit = std::max(limit, (total + n - 1) / n);
+
+    long long excess = 0;
+    for (auto& c : counts) {
+        if (c > limit) {
+            excess += c - limit;
+            c = limit;
+        }
+    }
+    while (excess > 0) {
+        long long open = 0;
+        for (long long c : counts) open += (c < limit);
+        long long share = std::max(1LL, excess / open);
+        for (int i = 0; i < n && excess > 0; ++i) {
+            long long give = std::min({ share, limit - counts[i], excess });
+            if (give <= 0) continue;
+            counts[i] += give;
+            excess -= give;
+        }
+    }
+}
+
+// Пропорционально весам: каждой белке орех и доля остального по весу,
+// остатки от округления - белкам с наибольшей дробной частью
+inline void partition_weighted(long long total, const std::vector<double>& weights, std::vector<long long>& counts) {
+    int n = static_cast<int>(weights.size());
+    counts.assign(n, 0);
+    if (partition_too_few(total, n, counts)) return;
+    long long remaining = total - static_cast<long long>(n);
+
+    long double weight_sum = 0.0L;
+    for (double w : weights) weight_sum += w;
+    std::vector<long double> frac(n);
+    long long given = 0;
+    for (int i = 0; i < n; ++i) {
+        long double share = (weight_sum > 0.0L) ? remaining * (weights[i] / weight_sum)
+                                                : static_cast<long double>(remaining) / n;
+        long long whole = static_cast<long long>(share);
+        counts[i] = 1 + whole;
+        frac[i] = share - whole;
+        given += whole;
+    }
+    std::vector<int> order(n);
+    for (int i = 0; i < n; ++i) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return frac[a] > frac[b]; });
+    for (long long k = 0; k < remaining - given; ++k) counts[order[k % n]] += 1;
+}
+
+// Перекос разбиения: наибольший кусок к среднему
+inline double partition_max_mean(const std::vector<long long>& counts) {
+    if (counts.empty()) return 1.0;
+    long long sum = 0, max = 0;
+    for (long long c : counts) {
+        sum += c;
+        max = std::max(max, c);
+    }
+    return sum > 0 ? static_cast<double>(max) * counts.size() / static_cast<double>(sum) : 1.0;
+}
+
+// Распределённое разбиение (--partition-mode distributed): каждый процесс сам находит числа орехов
+// только своих белок [first, first + count), никто не хранит весь вектор.
+//
+// even - по той же формуле, что partition_even, без всякой связи.
+// random - те же случайные разрезы, что в partition_random, но найденные деревом: отрезок белок
+// [lo, hi) с extra лишними орехами (сверх ореха на белку) делится на [lo, mid) и [mid, hi)
+// разрезом номер mid - lo из hi - lo - 1 равномерных разрезов [0, extra]. Такой разрез - это
+// floor((extra + 1) * B), B ~ Beta(mid - lo, hi - mid) (порядковая статистика равномерных),
+// а разрезы слева и справа от него снова равномерны на своих отрезках, поэтому куски распределены
+// так же, как в partition_random, хотя сами числа другие. Случайные числа узла берутся из
+// Philox (seed, номер узла), поэтому любой процесс получает для узла то же деление,
+// и всё дерево в сумме даёт ровно total орехов.
+// Процесс спускается только в узлы, задевающие его белки: O(log n + count) работы.
+// Отрезки не длиннее PARTITION_TREE_LEAF белок делятся сразу случайными разрезами.
+//
+// Все распределения здесь свои, а не из <random>: алгоритмы std::gamma_distribution и
+// std::uniform_int_distribution не заданы стандартом, и разбиение отличалось бы между
+// libstdc++, libc++ и MSVC. Своё зависит только от Philox и от std::log / std::sqrt / std::cos
+// (их последний бит теоретически может отличаться между библиотеками). Разбиение root
+// (partition_random) оставлено на mt19937 и std::uniform_int_distribution, как в исходной программе.
+
+// Поток случайных чисел узла node: блоки Philox (seed, node, поток 1 + k) -
+// не пересекаются с массами орехов (поток 0). Дешевле, чем засевать mt19937 на каждый узел дерева.
+struct PhiloxNodeStream {
+    std::uint64_t seed, node;
+    std::uint32_t block = 1;
+    philox_ctr_t buf = {};
+    int used = 4;
+
+    PhiloxNodeStream(std::uint64_t s, std::uint64_t n) : seed(s), node(n) {}
+
+    std::uint32_t next32() {
+        if (used == 4) {
+            buf = philox_nut_block(seed, node, block++);
+            used = 0;
+        }
+        return buf[used++];
+    }
+    std::uint64_t next64() {
+        std::uint64_t hi = next32();
+        return (hi << 32) | next32();
+    }
+    // равномерное на [0, 1)
+    double unit() {
+        std::uint32_t hi = next32();
+        return philox_to_unit(hi, next32());
+    }
+    // равномерное целое на [0, bound]: отбрасываем хвост, чтобы не было перекоса от остатка
+    std::uint64_t below_or_equal(std::uint64_t bound) {
+        if (bound == ~0ULL) return next64();
+        std::uint64_t range = bound + 1;
+        std::uint64_t reject = (0 - range) % range; // 2^64 mod range
+        std::uint64_t x = next64();
+        while (x < reject) x = next64();
+        return x % range;
+    }
+    // стандартное нормальное (Бокс - Мюллер, второе число пары не бережём)
+    double normal() {
+        double u1 = 1.0 - unit(); // (0, 1], чтобы не брать логарифм нуля
+        double u2 = unit();
+        return std::sqrt(-2.0 * std::log(u1)) * std::cos(6.283185307179586 * u2);
+    }
+    // Gamma(shape, 1) при shape >= 1 (Marsaglia, Tsang, 2000)
+    double gamma(double shape) {
+        const double d = shape - 1.0 / 3.0, c = 1.0 / std::sqrt(9.0 * d);
+        while (true) {
+            double x = normal();
+            double v = 1.0 + c * x;
+            if (v <= 0.0) continue;
+            v = v * v * v;
+            double u = unit();
+            if (u < 1.0 - 0.0331 * x * x * x * x) return d * v;
+            if (std::log(u) < 0.5 * x * x + d * (1.0 - v + std::log(v))) return d * v;
+        }
+    }
+};
+
+// Разрез узла node: сколько из extra лишних орехов достаётся левым n_left белкам (n_right - правым).
+// n_left, n_right >= 1: узел длиннее листа.
+inline long long partition_split_node(std::uint64_t seed, std::uint64_t node, long long extra,
+                                      long long n_left, long long n_right) {
+    if (extra == 0) return 0;
+    PhiloxNodeStream gen(seed, node);
+    double a = gen.gamma(static_cast<double>(n_left));
+    double b = gen.gamma(static_cast<double>(n_right));
+    double p = a / (a + b);
+    // p < 1, но (extra + 1) * p может округлиться до extra + 1
+    long long cut = static_cast<long long>(std::floor(static_cast<double>(extra + 1) * p));
+    return std::min(std::max(cut, 0LL), extra);
+}
+
+// Небольшие отрезки белок делятся сразу случайными разрезами, как в partition_random:
+// так на каждую белку приходится меньше бета-биномиальных делений
+const long long PARTITION_TREE_LEAF = 64;
+
+inline void partition_tree(std::uint64_t seed, std::uint64_t node, long long lo, long long hi, long long extra,
+                           long long first, long long count, long long* out) {
+    if (hi <= first || lo >= first + count) return;
+    if (hi - lo <= PARTITION_TREE_LEAF) {
+        PhiloxNodeStream gen(seed, node);
+        long long cuts[PARTITION_TREE_LEAF];
+        long long n = hi - lo;
+        for (long long i = 0; i + 1 < n; ++i) cuts[i] = static_cast<long long>(gen.below_or_equal(extra));
+        cuts[n - 1] = extra;
+        std::sort(cuts, cuts + n - 1);
+        long long prev = 0;
+        for (long long i = 0; i < n; ++i) {
+            long long id = lo + i;
+            if (id >= first && id < first + count) out[id - first] = 1 + (cuts[i] - prev);
+            prev = cuts[i];
+        }
+        return;
+    }
+    long long mid = lo + (hi - lo) / 2;
+    long long left = partition_split_node(seed, node, extra, mid - lo, hi - mid);
+    partition_tree(seed, 2 * node,     lo,  mid, left,         first, count, out);
+    partition_tree(seed, 2 * node + 1, mid, hi,  extra - left, first, count, out);
+}
+
+// Числа орехов белок [first, first + count) из n при total орехах; out - count чисел
+inline void partition_distributed(const std::string& strategy, std::uint64_t seed, long long total, int n,
+                                  int first, int count, long long* out) {
+    if (total < n || strategy == "even") {
+        for (int i = 0; i < count; ++i) {
+            long long id = first + i;
+            out[i] = (total < n) ? (id < total ? 1 : 0) : total / n + (id < total % n ? 1 : 0);
+        }
+        return;
+    }
+    partition_tree(seed, 1, 0, n, total - static_cast<long long>(n), first, count, out);
+}
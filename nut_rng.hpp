@@ -0,0 +1,76 @@
+#pragma once
+
+// Счётчиковый генератор масс орехов (Philox4x32-10, Salmon et al., SC'11).
+// Масса ореха с номером i зависит только от (seed, i), а не от того,
+// сколько орехов сгенерировано до него. Поэтому любая белка (процесс)
+// может сама сгенерировать свой кусок мешка [first, first + n), и результат
+// побитово совпадает с генерацией всего мешка на одном процессе.
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+
+const double NUT_MASS_MIN = 0.1;  // минимальная масса ореха
+const double NUT_MASS_MAX = 10.0; // максимальная масса ореха
+
+using philox_ctr_t = std::array<std::uint32_t, 4>;
+using philox_key_t = std::array<std::uint32_t, 2>;
+
+// Один блок Philox4x32-10: 128 бит счётчика -> 128 случайных бит
+inline philox_ctr_t philox4x32_10(philox_ctr_t ctr, philox_key_t key) {
+    const std::uint32_t M0 = 0xD2511F53u, M1 = 0xCD9E8D57u;
+    const std::uint32_t W0 = 0x9E3779B9u, W1 = 0xBB67AE85u;
+    for (int round = 0; round < 10; ++round) {
+        std::uint64_t p0 = static_cast<std::uint64_t>(M0) * ctr[0];
+        std::uint64_t p1 = static_cast<std::uint64_t>(M1) * ctr[2];
+        ctr = {
+            static_cast<std::uint32_t>(p1 >> 32) ^ ctr[1] ^ key[0],
+            static_cast<std::uint32_t>(p1),
+            static_cast<std::uint32_t>(p0 >> 32) ^ ctr[3] ^ key[1],
+            static_cast<std::uint32_t>(p0)
+        };
+        key[0] += W0;
+        key[1] += W1;
+    }
+    return ctr;
+}
+
+// 64 случайных бита -> число из [0, 1) с 53 значащими битами
+inline double philox_to_unit(std::uint32_t hi, std::uint32_t lo) {
+    std::uint64_t bits = (static_cast<std::uint64_t>(hi) << 32) | lo;
+    return static_cast<double>(bits >> 11) * (1.0 / 9007199254740992.0); // 2^-53
+}
+
+// Блок с номером block даёт два ореха: 2*block и 2*block + 1.
+// stream позволяет получить независимые последовательности при одном seed.
+inline philox_ctr_t philox_nut_block(std::uint64_t seed, std::uint64_t block, std::uint32_t stream = 0) {
+    philox_ctr_t ctr = { static_cast<std::uint32_t>(block), static_cast<std::uint32_t>(block >> 32), stream, 0 };
+    philox_key_t key = { static_cast<std::uint32_t>(seed), static_cast<std::uint32_t>(seed >> 32) };
+    return philox4x32_10(ctr, key);
+}
+
+// Масса одного ореха с глобальным номером index из [lo, hi)
+inline double philox_nut_mass(std::uint64_t seed, std::uint64_t index, double lo, double hi) {
+    philox_ctr_t r = philox_nut_block(seed, index >> 1);
+    double u = (index & 1) ? philox_to_unit(r[2], r[3]) : philox_to_unit(r[0], r[1]);
+    return lo + (hi - lo) * u;
+}
+
+// Заполняет out[0..n) массами орехов с глобальными номерами [first, first + n)
+inline void philox_fill_nuts(std::uint64_t seed, std::uint64_t first, double* out, std::size_t n, double lo, double hi) {
+    std::size_t k = 0;
+    std::uint64_t index = first;
+    // нечётное начало: первый орех берём из второй половины блока
+    if (n > 0 && (index & 1)) {
+        out[k++] = philox_nut_mass(seed, index++, lo, hi);
+    }
+    // основной цикл: по два ореха на блок
+    for (; k + 1 < n; k += 2, index += 2) {
+        philox_ctr_t r = philox_nut_block(seed, index >> 1);
+        out[k]     = lo + (hi - lo) * philox_to_unit(r[0], r[1]);
+        out[k + 1] = lo + (hi - lo) * philox_to_unit(r[2], r[3]);
+    }
+    if (k < n) {
+        out[k] = philox_nut_mass(seed, index, lo, hi);
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+// Сжатое описание распределения масс (--sketch hist): гистограмма из NUT_SKETCH_BINS равных
+// корзин на [NUT_MASS_MIN, NUT_MASS_MAX), число орехов, наименьшая и наибольшая масса.
+// Строится за один проход по куску белки и весит 2 КБ независимо от числа орехов.
+// Две гистограммы сливаются сложением корзин (min и max - минимумом и максимумом), поэтому
+// слияние точное и не зависит от порядка: гистограмма куска, собранная по частям, та же,
+// что у куска целиком. Так её можно отправлять соседкам и сворачивать в MPI_Reduce.
+//
+// Квантиль q - масса ореха номер q * (n - 1) по возрастанию: берём корзину, куда он попал,
+// и интерполируем внутри неё (q = 0 и q = 1 - точные min и max). Ошибка не больше ширины
+// корзины (9.9 / 256 ≈ 0.039), если массы лежат в [NUT_MASS_MIN, NUT_MASS_MAX);
+// массы вне отрезка попадают в крайние корзины.
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+#include "nut_rng.hpp"
+
+const int NUT_SKETCH_BINS = 256;
+
+struct NutSketch {
+    long long count = 0;
+    double min = std::numeric_limits<double>::infinity();
+    double max = -std::numeric_limits<double>::infinity();
+    long long bins[NUT_SKETCH_BINS] = {};
+};
+
+inline double nut_sketch_bin_width() {
+    return (NUT_MASS_MAX - NUT_MASS_MIN) / NUT_SKETCH_BINS;
+}
+
+// Добавляем n масс x
+inline void nut_sketch_add(NutSketch& s, const double* x, std::size_t n) {
+    const double inv_width = 1.0 / nut_sketch_bin_width();
+    double lo = s.min, hi = s.max;
+    for (std::size_t i = 0; i < n; ++i) {
+        double t = std::min(std::max((x[i] - NUT_MASS_MIN) * inv_width, 0.0), NUT_SKETCH_BINS - 1.0);
+        s.bins[static_cast<int>(t)] += 1;
+        lo = std::min(lo, x[i]);
+        hi = std::max(hi, x[i]);
+    }
+    s.min = lo;
+    s.max = hi;
+    s.count += static_cast<long long>(n);
+}
+
+// inout += in
+inline void nut_sketch_merge(const NutSketch& in, NutSketch& inout) {
+    inout.count += in.count;
+    inout.min = std::min(inout.min, in.min);
+    inout.max = std::max(inout.max, in.max);
+    for (int b = 0; b < NUT_SKETCH_BINS; ++b) inout.bins[b] += in.bins[b];
+}
+
+// Квантиль q из [0, 1]; у пустой гистограммы - 0, как средняя белки без орехов
+inline double nut_sketch_quantile(const NutSketch& s, double q) {
+    if (s.count == 0) return 0.0;
+    // крайние массы известны точно
+    if (q <= 0.0) return s.min;
+    if (q >= 1.0) return s.max;
+    double r = q * static_cast<double>(s.count - 1);
+    long long k = static_cast<long long>(r);
+    long long before = 0;
+    int b = 0;
+    while (b + 1 < NUT_SKETCH_BINS && before + s.bins[b] <= k) before += s.bins[b++];
+    // орехи корзины считаем равномерно разложенными по ней
+    double pos = (r - static_cast<double>(before) + 0.5) / static_cast<double>(std::max(s.bins[b], 1LL));
+    double x = NUT_MASS_MIN + (b + std::min(pos, 1.0)) * nut_sketch_bin_width();
+    return std::min(std::max(x, s.min), s.max);
+}
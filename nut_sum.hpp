@@ -0,0 +1,244 @@
+#pragma once
+
+// Ядра суммирования масс орехов.
+//  naive    - std::accumulate: одна цепочка сложений, каждое ждёт предыдущее
+//  simd     - несколько независимых аккумуляторов в векторных регистрах (AVX-512 / AVX2 / скаляр)
+//  kahan    - то же, но с компенсацией ошибки округления (Кэхэн) в каждой дорожке
+//  pairwise - попарное суммирование блоками, ошибка растёт как O(log n) вместо O(n)
+// Набор инструкций выбирается при запуске по возможностям процессора,
+// поэтому бинарник, собранный без -march, работает везде.
+
+#include <cstddef>
+#include <numeric>
+#include <string>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NUT_SUM_X86 1
+#include <immintrin.h>
+#endif
+
+using nut_sum_fn = double (*)(const double*, std::size_t);
+
+inline double nut_sum_naive(const double* x, std::size_t n) {
+    return std::accumulate(x, x + n, 0.0);
+}
+
+// Скалярный запасной вариант: 4 независимых аккумулятора
+inline double nut_sum_simd_scalar(const double* x, std::size_t n) {
+    double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        s0 += x[i];
+        s1 += x[i + 1];
+        s2 += x[i + 2];
+        s3 += x[i + 3];
+    }
+    for (; i < n; ++i) s0 += x[i];
+    return (s0 + s1) + (s2 + s3);
+}
+
+// Скалярный Кэхэн в 4 дорожках
+inline double nut_sum_kahan_scalar(const double* x, std::size_t n) {
+    double s[4] = { 0.0, 0.0, 0.0, 0.0 };
+    double c[4] = { 0.0, 0.0, 0.0, 0.0 };
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        for (int l = 0; l < 4; ++l) {
+            double y = x[i + l] - c[l];
+            double t = s[l] + y;
+            c[l] = (t - s[l]) - y;
+            s[l] = t;
+        }
+    }
+    for (; i < n; ++i) {
+        double y = x[i] - c[0];
+        double t = s[0] + y;
+        c[0] = (t - s[0]) - y;
+        s[0] = t;
+    }
+    // сводим дорожки тоже с компенсацией
+    double sum = 0.0, comp = 0.0;
+    for (int l = 0; l < 4; ++l) {
+        double y = (s[l] - c[l]) - comp;
+        double t = sum + y;
+        comp = (t - sum) - y;
+        sum = t;
+    }
+    return sum;
+}
+
+#ifdef NUT_SUM_X86
+
+// AVX2: 4 регистра по 4 double = 16 независимых цепочек сложений
+__attribute__((target("avx2"))) inline double nut_sum_simd_avx2(const double* x, std::size_t n) {
+    __m256d a0 = _mm256_setzero_pd(), a1 = _mm256_setzero_pd();
+    __m256d a2 = _mm256_setzero_pd(), a3 = _mm256_setzero_pd();
+    std::size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        a0 = _mm256_add_pd(a0, _mm256_loadu_pd(x + i));
+        a1 = _mm256_add_pd(a1, _mm256_loadu_pd(x + i + 4));
+        a2 = _mm256_add_pd(a2, _mm256_loadu_pd(x + i + 8));
+        a3 = _mm256_add_pd(a3, _mm256_loadu_pd(x + i + 12));
+    }
+    __m256d a = _mm256_add_pd(_mm256_add_pd(a0, a1), _mm256_add_pd(a2, a3));
+    alignas(32) double lanes[4];
+    _mm256_store_pd(lanes, a);
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + nut_sum_simd_scalar(x + i, n - i);
+}
+
+// AVX2 + Кэхэн: 2 регистра суммы и 2 регистра компенсации
+__attribute__((target("avx2"))) inline double nut_sum_kahan_avx2(const double* x, std::size_t n) {
+    __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+    __m256d c0 = _mm256_setzero_pd(), c1 = _mm256_setzero_pd();
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256d y0 = _mm256_sub_pd(_mm256_loadu_pd(x + i), c0);
+        __m256d y1 = _mm256_sub_pd(_mm256_loadu_pd(x + i + 4), c1);
+        __m256d t0 = _mm256_add_pd(s0, y0);
+        __m256d t1 = _mm256_add_pd(s1, y1);
+        c0 = _mm256_sub_pd(_mm256_sub_pd(t0, s0), y0);
+        c1 = _mm256_sub_pd(_mm256_sub_pd(t1, s1), y1);
+        s0 = t0;
+        s1 = t1;
+    }
+    alignas(32) double s[8], c[8];
+    _mm256_store_pd(s, s0);
+    _mm256_store_pd(s + 4, s1);
+    _mm256_store_pd(c, c0);
+    _mm256_store_pd(c + 4, c1);
+    double sum = 0.0, comp = 0.0;
+    for (int l = 0; l < 8; ++l) {
+        double y = (s[l] - c[l]) - comp;
+        double t = sum + y;
+        comp = (t - sum) - y;
+        sum = t;
+    }
+    // хвост тоже с компенсацией
+    for (; i < n; ++i) {
+        double y = x[i] - comp;
+        double t = sum + y;
+        comp = (t - sum) - y;
+        sum = t;
+    }
+    return sum;
+}
+
+// AVX-512: 4 регистра по 8 double = 32 независимые цепочки
+__attribute__((target("avx512f"))) inline double nut_sum_simd_avx512(const double* x, std::size_t n) {
+    __m512d a0 = _mm512_setzero_pd(), a1 = _mm512_setzero_pd();
+    __m512d a2 = _mm512_setzero_pd(), a3 = _mm512_setzero_pd();
+    std::size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        a0 = _mm512_add_pd(a0, _mm512_loadu_pd(x + i));
+        a1 = _mm512_add_pd(a1, _mm512_loadu_pd(x + i + 8));
+        a2 = _mm512_add_pd(a2, _mm512_loadu_pd(x + i + 16));
+        a3 = _mm512_add_pd(a3, _mm512_loadu_pd(x + i + 24));
+    }
+    __m512d a = _mm512_add_pd(_mm512_add_pd(a0, a1), _mm512_add_pd(a2, a3));
+    alignas(64) double lanes[8];
+    _mm512_store_pd(lanes, a);
+    double sum = ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+    return sum + nut_sum_simd_scalar(x + i, n - i);
+}
+
+// AVX-512 + Кэхэн
+__attribute__((target("avx512f"))) inline double nut_sum_kahan_avx512(const double* x, std::size_t n) {
+    __m512d s0 = _mm512_setzero_pd(), s1 = _mm512_setzero_pd();
+    __m512d c0 = _mm512_setzero_pd(), c1 = _mm512_setzero_pd();
+    std::size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512d y0 = _mm512_sub_pd(_mm512_loadu_pd(x + i), c0);
+        __m512d y1 = _mm512_sub_pd(_mm512_loadu_pd(x + i + 8), c1);
+        __m512d t0 = _mm512_add_pd(s0, y0);
+        __m512d t1 = _mm512_add_pd(s1, y1);
+        c0 = _mm512_sub_pd(_mm512_sub_pd(t0, s0), y0);
+        c1 = _mm512_sub_pd(_mm512_sub_pd(t1, s1), y1);
+        s0 = t0;
+        s1 = t1;
+    }
+    alignas(64) double s[16], c[16];
+    _mm512_store_pd(s, s0);
+    _mm512_store_pd(s + 8, s1);
+    _mm512_store_pd(c, c0);
+    _mm512_store_pd(c + 8, c1);
+    double sum = 0.0, comp = 0.0;
+    for (int l = 0; l < 16; ++l) {
+        double y = (s[l] - c[l]) - comp;
+        double t = sum + y;
+        comp = (t - sum) - y;
+        sum = t;
+    }
+    for (; i < n; ++i) {
+        double y = x[i] - comp;
+        double t = sum + y;
+        comp = (t - sum) - y;
+        sum = t;
+    }
+    return sum;
+}
+
+#endif // NUT_SUM_X86
+
+// Какой набор инструкций доступен: "avx512", "avx2" или "scalar"
+inline const char* nut_sum_isa() {
+#ifdef NUT_SUM_X86
+    static const char* isa = __builtin_cpu_supports("avx512f") ? "avx512"
+                           : __builtin_cpu_supports("avx2")    ? "avx2"
+                                                               : "scalar";
+    return isa;
+#else
+    return "scalar";
+#endif
+}
+
+inline double nut_sum_simd(const double* x, std::size_t n) {
+#ifdef NUT_SUM_X86
+    static const nut_sum_fn fn = std::string(nut_sum_isa()) == "avx512" ? nut_sum_simd_avx512
+                               : std::string(nut_sum_isa()) == "avx2"   ? nut_sum_simd_avx2
+                                                                        : nut_sum_simd_scalar;
+    return fn(x, n);
+#else
+    return nut_sum_simd_scalar(x, n);
+#endif
+}
+
+inline double nut_sum_kahan(const double* x, std::size_t n) {
+#ifdef NUT_SUM_X86
+    static const nut_sum_fn fn = std::string(nut_sum_isa()) == "avx512" ? nut_sum_kahan_avx512
+                               : std::string(nut_sum_isa()) == "avx2"   ? nut_sum_kahan_avx2
+                                                                        : nut_sum_kahan_scalar;
+    return fn(x, n);
+#else
+    return nut_sum_kahan_scalar(x, n);
+#endif
+}
+
+// Попарное суммирование: блоки по 256 орехов складываются векторным ядром,
+// а блоки между собой - деревом
+inline double nut_sum_pairwise(const double* x, std::size_t n) {
+    const std::size_t BLOCK = 256;
+    if (n <= BLOCK) return nut_sum_simd(x, n);
+    std::size_t half = (n / 2 + BLOCK - 1) / BLOCK * BLOCK; // левая половина кратна блоку
+    return nut_sum_pairwise(x, half) + nut_sum_pairwise(x + half, n - half);
+}
+
+// Эталонная сумма для проверки ядер (tests.cpp, bench_sum.cpp): Кэхэн в long double, медленно
+inline long double nut_sum_reference(const double* x, std::size_t n) {
+    long double sum = 0.0L, comp = 0.0L;
+    for (std::size_t i = 0; i < n; ++i) {
+        long double y = x[i] - comp;
+        long double t = sum + y;
+        comp = (t - sum) - y;
+        sum = t;
+    }
+    return sum;
+}
+
+// Ядро по имени из командной строки; nullptr, если имя неизвестно
+inline nut_sum_fn nut_sum_kernel(const std::string& name) {
+    if (name == "naive")    return nut_sum_naive;
+    if (name == "simd")     return nut_sum_simd;
+    if (name == "kahan")    return nut_sum_kahan;
+    if (name == "pairwise") return nut_sum_pairwise;
+    return nullptr;
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+// Сжатый формат масс для рассылки мешка (--wire). Массы лежат в [NUT_MASS_MIN, NUT_MASS_MAX),
+// так что 8 байт double на орех избыточны:
+//
+//   f64 - как есть, 8 байт на орех, без потерь
+//   f32 - float, 4 байта; ошибка ореха не больше |x| * 2^-24 (<= 6e-7 при x < 10)
+//   q24 - 3 байта: код k из [0, 2^24 - 1], x = lo + k * step
+//   q16 - 2 байта: то же с 16-битным кодом
+//
+// В q16/q24 мешок режется на куски по NUT_WIRE_CHUNK орехов, у каждого куска свой
+// заголовок {lo, step} (два double): lo - наименьшая масса куска, step = (max - lo) / (2^bits - 1).
+// Код округляется до ближайшего, поэтому ошибка ореха не больше step / 2 <=
+// (NUT_MASS_MAX - NUT_MASS_MIN) / (2 * (2^bits - 1)): 7.6e-5 для q16 и 3.0e-7 для q24.
+// Средняя белки - среднее орехов, поэтому её ошибка не больше ошибки одного ореха
+// (nut_wire_error_bound); на деле ошибки округления гасят друг друга и она в сотни раз меньше.
+// Байты пишутся в порядке little-endian, заголовок - memcpy double.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "nut_rng.hpp"
+
+const std::size_t NUT_WIRE_CHUNK = 4096; // орехов на кусок со своим масштабом
+const std::size_t NUT_WIRE_CHUNK_HEADER = 2 * sizeof(double);
+
+// Байт на орех в формате format (0 - неизвестный формат)
+inline std::size_t nut_wire_width(const std::string& format) {
+    if (format == "f64") return 8;
+    if (format == "f32") return 4;
+    if (format == "q24") return 3;
+    if (format == "q16") return 2;
+    return 0;
+}
+
+// Сколько байт занимают n орехов в формате format (вместе с заголовками кусков)
+inline std::size_t nut_wire_bytes(const std::string& format, std::size_t n) {
+    std::size_t bytes = n * nut_wire_width(format);
+    if (format == "q16" || format == "q24") {
+        bytes += (n + NUT_WIRE_CHUNK - 1) / NUT_WIRE_CHUNK * NUT_WIRE_CHUNK_HEADER;
+    }
+    return bytes;
+}
+
+// Гарантированная граница ошибки одной массы (и средней белки) для масс из [lo, hi)
+inline double nut_wire_error_bound(const std::string& format, double lo = NUT_MASS_MIN, double hi = NUT_MASS_MAX) {
+    if (format == "f32") return std::max(std::fabs(lo), std::fabs(hi)) * std::ldexp(1.0, -24);
+    if (format == "q24") return (hi - lo) / (2.0 * ((1 << 24) - 1));
+    if (format == "q16") return (hi - lo) / (2.0 * ((1 << 16) - 1));
+    return 0.0;
+}
+
+// Кодируем n масс x в out (nut_wire_bytes(format, n) байт)
+inline void nut_wire_encode(const std::string& format, const double* x, std::size_t n, unsigned char* out) {
+    if (format == "f64") {
+        std::memcpy(out, x, n * sizeof(double));
+        return;
+    }
+    if (format == "f32") {
+        for (std::size_t i = 0; i < n; ++i) {
+            float f = static_cast<float>(x[i]);
+            std::memcpy(out + 4 * i, &f, sizeof(f));
+        }
+        return;
+    }
+    const int width = static_cast<int>(nut_wire_width(format));
+    const double levels = (format == "q24") ? double((1 << 24) - 1) : double((1 << 16) - 1);
+    for (std::size_t c = 0; c < n; c += NUT_WIRE_CHUNK) {
+        std::size_t m = std::min(NUT_WIRE_CHUNK, n - c);
+        double lo = *std::min_element(x + c, x + c + m);
+        double hi = *std::max_element(x + c, x + c + m);
+        double step = (hi > lo) ? (hi - lo) / levels : 1.0;
+        std::memcpy(out, &lo, sizeof(lo));
+        std::memcpy(out + sizeof(lo), &step, sizeof(step));
+        out += NUT_WIRE_CHUNK_HEADER;
+        const double inv_step = 1.0 / step;
+        for (std::size_t i = 0; i < m; ++i) {
+            // x >= lo, поэтому округление до ближайшего - floor(t + 0.5)
+            double k = std::min(levels, std::floor((x[c + i] - lo) * inv_step + 0.5));
+            std::uint32_t code = static_cast<std::uint32_t>(k);
+            for (int b = 0; b < width; ++b) out[b] = static_cast<unsigned char>(code >> (8 * b));
+            out += width;
+        }
+    }
+}
+
+// Раскодируем n масс из in в out
+inline void nut_wire_decode(const std::string& format, const unsigned char* in, std::size_t n, double* out) {
+    if (format == "f64") {
+        std::memcpy(out, in, n * sizeof(double));
+        return;
+    }
+    if (format == "f32") {
+        for (std::size_t i = 0; i < n; ++i) {
+            float f;
+            std::memcpy(&f, in + 4 * i, sizeof(f));
+            out[i] = f;
+        }
+        return;
+    }
+    const int width = static_cast<int>(nut_wire_width(format));
+    for (std::size_t c = 0; c < n; c += NUT_WIRE_CHUNK) {
+        std::size_t m = std::min(NUT_WIRE_CHUNK, n - c);
+        double lo, step;
+        std::memcpy(&lo, in, sizeof(lo));
+        std::memcpy(&step, in + sizeof(lo), sizeof(step));
+        in += NUT_WIRE_CHUNK_HEADER;
+        for (std::size_t i = 0; i < m; ++i) {
+            std::uint32_t code = 0;
+            for (int b = 0; b < width; ++b) code |= static_cast<std::uint32_t>(in[b]) << (8 * b);
+            out[c + i] = lo + code * step;
+            in += width;
+        }
+    }
+}
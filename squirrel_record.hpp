@@ -0,0 +1,47 @@
+#pragma once
+
+// Структурированный вывод результатов (--output csv | bin): одна запись фиксированной
+// длины на белку, записи упорядочены по номеру белки. Запись белки i лежит по смещению
+// заголовок + i * длина записи, поэтому каждый процесс пишет свои белки в общий файл
+// сам (MPI_File_write_at_all), без пересылки на root.
+//
+//   bin: SquirrelRecord подряд, без заголовка, little-endian, 40 байт на белку
+//   csv: строка заголовка SQUIRREL_CSV_HEADER, затем строки по SQUIRREL_CSV_RECORD_LEN байт
+//        с полями, выровненными пробелами: id, nuts, avg, left, right (массы - 17 знаков)
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+struct SquirrelRecord {
+    std::int64_t id = 0;   // номер белки
+    std::int64_t nuts = 0; // сколько орехов ей досталось
+    double avg = 0.0;      // её средний вес ореха
+    double left = 0.0;     // средний вес соседки слева
+    double right = 0.0;    // средний вес соседки справа
+};
+
+static_assert(sizeof(SquirrelRecord) == 40, "запись белки должна занимать 40 байт");
+
+const char* const SQUIRREL_CSV_HEADER = "id,nuts,avg,left,right\n";
+const std::size_t SQUIRREL_CSV_HEADER_LEN = 23;
+// 10 знаков id, 20 знаков числа орехов, по 25 знаков на каждое среднее, 4 запятые и перевод строки
+const std::size_t SQUIRREL_CSV_RECORD_LEN = 10 + 20 + 3 * 25 + 4 + 1;
+
+inline std::string format_squirrel_csv(const SquirrelRecord& r) {
+    char buf[SQUIRREL_CSV_RECORD_LEN + 1];
+    std::snprintf(buf, sizeof(buf), "%10lld,%20lld,%25.17e,%25.17e,%25.17e\n",
+                  static_cast<long long>(r.id), static_cast<long long>(r.nuts), r.avg, r.left, r.right);
+    return std::string(buf, SQUIRREL_CSV_RECORD_LEN);
+}
+
+// Разбираем строку CSV (без перевода строки или с ним); false, если строка не запись
+inline bool parse_squirrel_csv(const std::string& line, SquirrelRecord& r) {
+    long long id = 0, nuts = 0;
+    if (std::sscanf(line.c_str(), "%lld,%lld,%lf,%lf,%lf", &id, &nuts, &r.avg, &r.left, &r.right) != 5) {
+        return false;
+    }
+    r.id = id;
+    r.nuts = nuts;
+    return true;
+}
@@ -0,0 +1,1632 @@
+#include <mpi.h>
+#include <vector>
+#include <random>
+#include <numeric>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <fstream>
+#include <algorithm>
+#include <string>
+#include <cstdint>
+#include <limits>
+#include <cmath>
+#include <list>
+#include <chrono>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "latency_hist.hpp"
+#include "nut_bag.hpp"
+#include "nut_partition.hpp"
+#include "nut_rng.hpp"
+#include "nut_sketch.hpp"
+#include "nut_sum.hpp"
+#include "nut_wire.hpp"
+#include "squirrel_record.hpp"
+#include "squirrels.hpp"
+
+bool parse_options(int argc, char** argv, Options& opt, std::string& err) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        // единственный параметр без значения
+        if (arg == "--profile") {
+            opt.profile = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            err = "нет значения для параметра " + arg;
+            return false;
+        }
+        std::string val = argv[++i];
+        if (arg == "--gen") {
+            opt.gen = val;
+        } else if (arg == "--dist") {
+            opt.dist = val;
+        } else if (arg == "--exchange") {
+            opt.exchange = val;
+        } else if (arg == "--squirrels") {
+            opt.num_squirrels = std::stoi(val);
+        } else if (arg == "--nuts") {
+            opt.total_nuts = std::stoll(val);
+        } else if (arg == "--scatter-chunk") {
+            opt.scatter_chunk = std::stoll(val);
+        } else if (arg == "--sum") {
+            opt.sum = val;
+        } else if (arg == "--input") {
+            opt.input = val;
+        } else if (arg == "--io") {
+            opt.io = val;
+        } else if (arg == "--output") {
+            opt.output = val;
+        } else if (arg == "--out-file") {
+            opt.out_file = val;
+        } else if (arg == "--profile-out") {
+            opt.profile = true;
+            opt.profile_out = val;
+        } else if (arg == "--partition") {
+            opt.partition = val;
+        } else if (arg == "--partition-cap") {
+            opt.partition_cap = std::stod(val);
+        } else if (arg == "--partition-mode") {
+            opt.partition_mode = val;
+        } else if (arg == "--rounds") {
+            opt.rounds = std::stoll(val);
+        } else if (arg == "--tolerance") {
+            opt.tolerance = std::stod(val);
+        } else if (arg == "--check-every") {
+            opt.check_every = std::stoi(val);
+        } else if (arg == "--trade-rate") {
+            opt.trade_rate = std::stod(val);
+        } else if (arg == "--stream") {
+            opt.stream = std::stoll(val);
+        } else if (arg == "--stream-threshold") {
+            opt.stream_threshold = std::stod(val);
+        } else if (arg == "--wire") {
+            opt.wire = val;
+        } else if (arg == "--max-message") {
+            opt.max_message = std::stoll(val);
+        } else if (arg == "--node-size") {
+            opt.node_size = std::stoi(val);
+        } else if (arg == "--sketch") {
+            opt.sketch = val;
+        } else if (arg == "--sketch-out") {
+            opt.sketch_out = val;
+        } else if (arg == "--weights") {
+            opt.weights = val;
+        } else if (arg == "--seed") {
+            opt.seed = std::stoull(val);
+        } else {
+            err = "неизвестный параметр " + arg;
+            return false;
+        }
+    }
+    return validate_options(opt, err);
+}
+
+bool validate_options(Options& opt, std::string& err) {
+    if (opt.gen != "mt19937" && opt.gen != "philox") {
+        err = "--gen должен быть mt19937 или philox";
+        return false;
+    }
+    if (opt.dist != "scatter" && opt.dist != "local" && opt.dist != "shm") {
+        err = "--dist должен быть scatter, local или shm";
+        return false;
+    }
+    if (opt.max_message < 1 || opt.max_message > std::numeric_limits<int>::max()) {
+        err = "--max-message должен быть от 1 до " + std::to_string(std::numeric_limits<int>::max());
+        return false;
+    }
+    if (opt.node_size < 0 || (opt.node_size > 0 && opt.dist != "shm")) {
+        err = "--node-size должен быть неотрицательным и имеет смысл только с --dist shm";
+        return false;
+    }
+    if (opt.num_squirrels < 1) {
+        err = "--squirrels должен быть положительным";
+        return false;
+    }
+    if (opt.total_nuts < 0) {
+        err = "--nuts должен быть неотрицательным";
+        return false;
+    }
+    // размер куска уходит в int-счётчики одного раунда рассылки
+    if (opt.scatter_chunk < 0 || opt.scatter_chunk > std::numeric_limits<int>::max()) {
+        err = "--scatter-chunk должен быть от 0 до " + std::to_string(std::numeric_limits<int>::max());
+        return false;
+    }
+    if (nut_sum_kernel(opt.sum) == nullptr) {
+        err = "--sum должен быть naive, simd, kahan или pairwise";
+        return false;
+    }
+    if (opt.exchange != "allgather" && opt.exchange != "cart" && opt.exchange != "sendrecv") {
+        err = "--exchange должен быть allgather, cart или sendrecv";
+        return false;
+    }
+    // mt19937 последовательный: кусок из середины мешка без генерации всего начала не получить
+    if (opt.dist == "local" && opt.gen != "philox") {
+        err = "--dist local работает только с --gen philox";
+        return false;
+    }
+    if (opt.sketch != "none" && opt.sketch != "hist") {
+        err = "--sketch должен быть none или hist";
+        return false;
+    }
+    if (!opt.sketch_out.empty() && opt.sketch != "hist") {
+        err = "--sketch-out работает только с --sketch hist";
+        return false;
+    }
+    if (opt.dist == "shm" && (!opt.input.empty() || opt.wire != "f64")) {
+        err = "--dist shm нельзя сочетать с --input и --wire";
+        return false;
+    }
+    if (opt.scatter_chunk > 0 && opt.dist != "scatter") {
+        err = "--scatter-chunk имеет смысл только с --dist scatter";
+        return false;
+    }
+    if (opt.output != "text" && opt.output != "csv" && opt.output != "bin" && opt.output != "summary"
+        && opt.output != "none") {
+        err = "--output должен быть text, csv, bin, summary или none";
+        return false;
+    }
+    if (opt.out_file.empty()) {
+        opt.out_file = (opt.output == "bin") ? "squirrels.bin" : "squirrels.csv";
+    }
+    if (opt.io != "mpiio" && opt.io != "mmap") {
+        err = "--io должен быть mpiio или mmap";
+        return false;
+    }
+    if (opt.partition != "random" && opt.partition != "even" && opt.partition != "bounded-random"
+        && opt.partition != "weighted") {
+        err = "--partition должен быть random, even, bounded-random или weighted";
+        return false;
+    }
+    if (!(opt.partition_cap >= 1.0)) {
+        err = "--partition-cap должен быть не меньше 1";
+        return false;
+    }
+    if (!opt.weights.empty() && opt.partition != "weighted") {
+        err = "--weights имеет смысл только с --partition weighted";
+        return false;
+    }
+    if (opt.partition_mode != "root" && opt.partition_mode != "distributed") {
+        err = "--partition-mode должен быть root или distributed";
+        return false;
+    }
+    // без root массы должны появиться на месте, а стратегия - считаться по кусочкам
+    if (opt.partition_mode == "distributed") {
+        if (opt.dist != "local" && opt.input.empty()) {
+            err = "--partition-mode distributed работает только с --dist local или --input";
+            return false;
+        }
+        if (opt.partition != "random" && opt.partition != "even") {
+            err = "--partition-mode distributed поддерживает только --partition random и even";
+            return false;
+        }
+    }
+    if (opt.rounds < 0 || opt.check_every < 1 || !(opt.tolerance >= 0.0)) {
+        err = "--rounds и --tolerance должны быть неотрицательными, --check-every - положительным";
+        return false;
+    }
+    // при rate > 0.5 явная схема диффузии неустойчива
+    if (!(opt.trade_rate > 0.0 && opt.trade_rate <= 0.5)) {
+        err = "--trade-rate должен быть из (0, 0.5]";
+        return false;
+    }
+    if (opt.tolerance > 0.0 && opt.rounds == 0) {
+        err = "--tolerance имеет смысл только с --rounds";
+        return false;
+    }
+    if (opt.stream < 0 || opt.stream > std::numeric_limits<int>::max() || !(opt.stream_threshold >= 0.0)) {
+        err = "--stream должен быть от 0 до " + std::to_string(std::numeric_limits<int>::max())
+            + ", --stream-threshold - неотрицательным";
+        return false;
+    }
+    // порции генерируются или читаются на месте, root ничего не рассылает
+    if (opt.stream > 0 && opt.dist != "local" && opt.input.empty()) {
+        err = "--stream работает только с --dist local или --input";
+        return false;
+    }
+    if (nut_wire_width(opt.wire) == 0) {
+        err = "--wire должен быть f64, f32, q24 или q16";
+        return false;
+    }
+    if (opt.wire != "f64" && (opt.dist != "scatter" || !opt.input.empty() || opt.scatter_chunk > 0)) {
+        err = "--wire f32/q24/q16 работает только для одной рассылки от root (--dist scatter без --input и --scatter-chunk)";
+        return false;
+    }
+    // из файла каждая белка читает свой кусок сама, рассылать нечего
+    if (!opt.input.empty() && (opt.dist != "scatter" || opt.scatter_chunk > 0)) {
+        err = "--input нельзя сочетать с --dist local и --scatter-chunk";
+        return false;
+    }
+    return true;
+}
+
+// Белки распределены по процессам блоками: процесс rank отвечает за белок
+// с номерами [first_squirrel(rank), first_squirrel(rank + 1)).
+int first_squirrel(int rank, int size, int num_squirrels) {
+    return static_cast<int>(static_cast<long long>(num_squirrels) * rank / size);
+}
+
+// Сколько белок у каждого процесса и с какой белки начинается его блок
+void squirrel_blocks(int size, int num_squirrels, std::vector<int>& counts, std::vector<int>& firsts) {
+    counts.resize(size);
+    firsts.resize(size);
+    for (int r = 0; r < size; ++r) {
+        firsts[r] = first_squirrel(r, size, num_squirrels);
+        counts[r] = first_squirrel(r + 1, size, num_squirrels) - firsts[r];
+    }
+}
+
+// Производительность процесса для --partition weighted: сколько орехов в секунду
+// суммирует ядро kernel (лучший из нескольких замеров на 2^20 орехах)
+double measure_rank_capacity(nut_sum_fn kernel) {
+    std::vector<double> probe(1 << 20);
+    philox_fill_nuts(0, 0, probe.data(), probe.size(), NUT_MASS_MIN, NUT_MASS_MAX);
+    double best = 0.0;
+    volatile double sink = 0.0;
+    for (int k = 0; k < 5; ++k) {
+        double t0 = MPI_Wtime();
+        sink = sink + kernel(probe.data(), probe.size());
+        double t = MPI_Wtime() - t0;
+        if (k == 0 || t < best) best = t;
+    }
+    return best > 0.0 ? static_cast<double>(probe.size()) / best : 1.0;
+}
+
+// Веса процессов из файла: по положительному числу на процесс (через пробелы или переводы строк)
+bool read_rank_weights(const std::string& path, int size, std::vector<double>& weights, std::string& err) {
+    std::ifstream fin(path);
+    if (!fin.is_open()) {
+        err = "не удалось открыть файл весов " + path;
+        return false;
+    }
+    weights.clear();
+    double w = 0.0;
+    while (fin >> w) {
+        if (!(w > 0.0)) {
+            err = "веса в " + path + " должны быть положительными";
+            return false;
+        }
+        weights.push_back(w);
+    }
+    if (static_cast<int>(weights.size()) != size) {
+        err = "в " + path + " " + std::to_string(weights.size()) + " весов, а процессов " + std::to_string(size);
+        return false;
+    }
+    return true;
+}
+
+// Обмен средними с соседками по кругу. Внутри процесса белки видят соседок
+// напрямую, поэтому между процессами нужно передать только средние крайних
+// белок блока: ghost_left - средняя белки перед нашим блоком,
+// ghost_right - средняя белки после него.
+//  allgather - все получают массив всех средних (O(N) памяти и трафика на процесс)
+//  cart      - периодическая одномерная декартова топология и MPI_Neighbor_alltoall
+//  sendrecv  - два MPI_Sendrecv по кольцу
+// В cart и sendrecv трафик и память на процесс не зависят от числа белок.
+void exchange_with_neighbours(const std::string& mode, MPI_Comm comm, int num_squirrels,
+                              const std::vector<double>& my_avgs,
+                              double& ghost_left, double& ghost_right) {
+    int size = 0, rank = 0;
+    MPI_Comm_size(comm, &size);
+    MPI_Comm_rank(comm, &rank);
+    int left  = (rank - 1 + size) % size;
+    int right = (rank + 1) % size;
+    double first_avg = my_avgs.front();
+    double last_avg  = my_avgs.back();
+
+    if (mode == "cart") {
+        MPI_Comm ring;
+        int dims[1]    = { size };
+        int periods[1] = { 1 };
+        // reorder = 0: номера процессов в кольце совпадают с исходными
+        MPI_Cart_create(comm, 1, dims, periods, 0, &ring);
+        // порядок соседей в декартовой топологии: сначала -1 (слева), потом +1 (справа).
+        // Левому процессу отдаём первую белку блока, правому - последнюю.
+        double to_neighbours[2]   = { first_avg, last_avg };
+        double from_neighbours[2] = { 0.0, 0.0 };
+        MPI_Neighbor_alltoall(to_neighbours, 1, MPI_DOUBLE, from_neighbours, 1, MPI_DOUBLE, ring);
+        MPI_Comm_free(&ring);
+        ghost_left  = from_neighbours[0];
+        ghost_right = from_neighbours[1];
+    } else if (mode == "sendrecv") {
+        // последнюю белку отправляем правому процессу и получаем последнюю белку левого,
+        // затем первую - левому и получаем первую белку правого
+        MPI_Sendrecv(&last_avg, 1, MPI_DOUBLE, right, 0,
+                     &ghost_left, 1, MPI_DOUBLE, left, 0, comm, MPI_STATUS_IGNORE);
+        MPI_Sendrecv(&first_avg, 1, MPI_DOUBLE, left, 1,
+                     &ghost_right, 1, MPI_DOUBLE, right, 1, comm, MPI_STATUS_IGNORE);
+    } else {
+        // Коллективный обмен: все получают массив средних всех белок
+        std::vector<int> counts, firsts;
+        squirrel_blocks(size, num_squirrels, counts, firsts);
+        std::vector<double> all_avgs(num_squirrels);
+        MPI_Allgatherv(my_avgs.data(), static_cast<int>(my_avgs.size()), MPI_DOUBLE,
+                       all_avgs.data(), counts.data(), firsts.data(), MPI_DOUBLE, comm);
+        int first = firsts[rank];
+        int last  = first + counts[rank] - 1;
+        ghost_left  = all_avgs[(first - 1 + num_squirrels) % num_squirrels];
+        ghost_right = all_avgs[(last + 1) % num_squirrels];
+    }
+}
+
+// Гистограммы (--sketch hist) пересылаются как непрозрачный блок байт, а сворачиваются
+// своей операцией: корзины складываются, min и max берутся по отдельности
+void sketch_merge_op(void* in, void* inout, int* len, MPI_Datatype*) {
+    const NutSketch* a = static_cast<const NutSketch*>(in);
+    NutSketch* b = static_cast<NutSketch*>(inout);
+    for (int i = 0; i < *len; ++i) nut_sketch_merge(a[i], b[i]);
+}
+
+// Сводки задержек (--profile) сворачиваются на root так же, блоком байт и своей операцией
+void latency_merge_op(void* in, void* inout, int* len, MPI_Datatype*) {
+    const LatencyHist* a = static_cast<const LatencyHist*>(in);
+    LatencyHist* b = static_cast<LatencyHist*>(inout);
+    for (int i = 0; i < *len; ++i) latency_hist_merge(a[i], b[i]);
+}
+
+// Гистограммы соседок на краях блока - те же пары сообщений, что и у средних в режиме sendrecv:
+// 2 КБ на сообщение при любом размере мешка
+void exchange_sketches(MPI_Comm comm, MPI_Datatype type, const std::vector<NutSketch>& mine,
+                       NutSketch& ghost_left, NutSketch& ghost_right) {
+    int size = 0, rank = 0;
+    MPI_Comm_size(comm, &size);
+    MPI_Comm_rank(comm, &rank);
+    int left  = (rank - 1 + size) % size;
+    int right = (rank + 1) % size;
+    MPI_Sendrecv(&mine.back(), 1, type, right, 0, &ghost_left, 1, type, left, 0, comm, MPI_STATUS_IGNORE);
+    MPI_Sendrecv(&mine.front(), 1, type, left, 1, &ghost_right, 1, type, right, 1, comm, MPI_STATUS_IGNORE);
+}
+
+// Раунды обмена массой по кругу: за раунд белка i отдаёт соседкам долю rate разницы средних,
+//   v_i += rate * (v_left + v_right - 2 * v_i),
+// так что сумма средних сохраняется, а сами средние выравниваются к их среднему по белкам.
+// Обмен между процессами - те же крайние белки блока, что и в exchange_with_neighbours, но через
+// постоянные запросы (MPI_Send_init / MPI_Recv_init): они создаются один раз, а в раунде только
+// запускаются MPI_Startall. Пока сообщения в пути, считаются внутренние белки блока, крайним
+// нужны ghost-значения, их считаем после MPI_Waitall.
+// Сходимость проверяется раз в check_every раундов неблокирующим MPI_Iallreduce, результат
+// которого забираем на следующей проверке: раунды не ждут редукцию, а решение об остановке
+// все процессы принимают на одном и том же раунде.
+TradeStats trade_rounds(MPI_Comm comm, const Options& opt, std::vector<double>& vals) {
+    int size = 0, rank = 0;
+    MPI_Comm_size(comm, &size);
+    MPI_Comm_rank(comm, &rank);
+    int left  = (rank - 1 + size) % size;
+    int right = (rank + 1) % size;
+    const int n = static_cast<int>(vals.size());
+    const double a = opt.trade_rate;
+
+    // tag 0 - последняя белка блока правому процессу, tag 1 - первая белка левому
+    double send_buf[2] = { 0.0, 0.0 }; // первая и последняя белка блока
+    double ghost_left = 0.0, ghost_right = 0.0;
+    MPI_Request reqs[4];
+    MPI_Recv_init(&ghost_left,  1, MPI_DOUBLE, left,  0, comm, &reqs[0]);
+    MPI_Recv_init(&ghost_right, 1, MPI_DOUBLE, right, 1, comm, &reqs[1]);
+    MPI_Send_init(&send_buf[1], 1, MPI_DOUBLE, right, 0, comm, &reqs[2]);
+    MPI_Send_init(&send_buf[0], 1, MPI_DOUBLE, left,  1, comm, &reqs[3]);
+
+    TradeStats stats;
+    std::vector<double> next(n);
+    double local_residual = 0.0;
+    double check_residual = 0.0, global_residual = 0.0;
+    MPI_Request check_req = MPI_REQUEST_NULL;
+
+    for (long long round = 0; round < opt.rounds; ++round) {
+        double t0 = MPI_Wtime();
+        send_buf[0] = vals.front();
+        send_buf[1] = vals.back();
+        MPI_Startall(4, reqs);
+
+        // внутренние белки не ждут соседние процессы
+        #pragma omp parallel for schedule(static) if (n > 100000)
+        for (int i = 1; i < n - 1; ++i) {
+            next[i] = vals[i] + a * (vals[i - 1] + vals[i + 1] - 2.0 * vals[i]);
+        }
+        MPI_Waitall(4, reqs, MPI_STATUSES_IGNORE);
+        next[0] = vals[0] + a * (ghost_left + (n > 1 ? vals[1] : ghost_right) - 2.0 * vals[0]);
+        if (n > 1) next[n - 1] = vals[n - 1] + a * (vals[n - 2] + ghost_right - 2.0 * vals[n - 1]);
+
+        local_residual = 0.0;
+        for (int i = 0; i < n; ++i) local_residual = std::max(local_residual, std::fabs(next[i] - vals[i]));
+        vals.swap(next);
+        ++stats.rounds;
+        latency_hist_add(stats.round_times, MPI_Wtime() - t0);
+
+        if (opt.tolerance > 0.0 && (round + 1) % opt.check_every == 0) {
+            if (check_req != MPI_REQUEST_NULL) {
+                MPI_Wait(&check_req, MPI_STATUS_IGNORE);
+                if (global_residual < opt.tolerance) {
+                    stats.converged = true;
+                    break;
+                }
+            }
+            check_residual = local_residual;
+            MPI_Iallreduce(&check_residual, &global_residual, 1, MPI_DOUBLE, MPI_MAX, comm, &check_req);
+        }
+    }
+    if (check_req != MPI_REQUEST_NULL) MPI_Wait(&check_req, MPI_STATUS_IGNORE);
+    for (auto& req : reqs) MPI_Request_free(&req);
+
+    MPI_Allreduce(&local_residual, &stats.residual, 1, MPI_DOUBLE, MPI_MAX, comm);
+    return stats;
+}
+
+// Время в секундах по монотонным часам узла (общим для всех его процессов)
+double stream_clock() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Потоковый режим: орехи белки приходят порциями по batch штук (генерируются Philox
+// или читаются из файла мешка), и белка хранит только текущую порцию и статистику
+// Уэлфорда (число, среднее, M2), поэтому память процесса не зависит от числа орехов.
+// Порция сливается со статистикой формулой Чана:
+//   delta = m_b - m,  m += delta * n_b / (n + n_b),  M2 += M2_b + delta^2 * n * n_b / (n + n_b).
+// После каждой порции крайние белки блока сообщают соседним процессам новую среднюю,
+// но только если она ушла от последней отправленной больше чем на threshold. Сообщение -
+// {средняя, время прихода порции, последнее ли}; получатель забирает их MPI_Iprobe между
+// порциями и меряет задержку до обновления своего ghost-значения. Время берётся из
+// stream_clock, а не MPI_Wtime (в Open MPI у каждого процесса свой ноль): на одном узле
+// оно общее у всех процессов, между узлами - если часы узлов синхронизированы. В конце каждый
+// процесс отправляет итоговые средние с флагом «последнее» и ждёт такие же от соседей:
+// сообщения одной пары не обгоняют друг друга, так что после них ghost-значения точные.
+StreamStats stream_squirrels(MPI_Comm comm, const Options& opt, bool file_input, std::uint32_t dtype,
+                             long long local_displ, const std::vector<long long>& my_counts,
+                             const std::vector<long long>& my_offsets, nut_sum_fn kernel,
+                             std::vector<double>& means, std::vector<double>& m2,
+                             double& ghost_left, double& ghost_right, NutSketch* sketches) {
+    int size = 0, rank = 0;
+    MPI_Comm_size(comm, &size);
+    MPI_Comm_rank(comm, &rank);
+    int left  = (rank - 1 + size) % size;
+    int right = (rank + 1) % size;
+    const int n = static_cast<int>(my_counts.size());
+    const long long batch = opt.stream;
+
+    MPI_File fh = MPI_FILE_NULL;
+    if (file_input && MPI_File_open(comm, opt.input.c_str(), MPI_MODE_RDONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+        std::cerr << "Ошибка: MPI_File_open не смог открыть " << opt.input << std::endl;
+        MPI_Abort(comm, 3);
+    }
+    const MPI_Offset elem = static_cast<MPI_Offset>(nut_bag_elem_size(dtype));
+
+    // порция не длиннее самого большого куска белки процесса: огромный --stream не раздувает буфер
+    long long max_count = my_counts.empty() ? 0 : *std::max_element(my_counts.begin(), my_counts.end());
+    const std::size_t piece_size = static_cast<std::size_t>(std::min(batch, max_count));
+    std::vector<double> piece(piece_size);
+    std::vector<float> piece_f32(dtype == NUT_BAG_F32 && file_input ? piece_size : 0);
+    std::vector<long long> seen(n, 0);
+    means.assign(n, 0.0);
+    m2.assign(n, 0.0);
+
+    // tag 0 - последняя белка блока правому процессу, tag 1 - первая белка левому
+    struct Update { double msg[3]; MPI_Request req; };
+    std::list<Update> in_flight; // буферы отправленных сообщений живут до завершения MPI_Isend
+    double sent_first = std::numeric_limits<double>::quiet_NaN(), sent_last = sent_first;
+    StreamStats stats;
+
+    auto send_update = [&](double value, double arrived, bool last, int dest, int tag) {
+        in_flight.push_back(Update{ { value, arrived, last ? 1.0 : 0.0 }, MPI_REQUEST_NULL });
+        Update& u = in_flight.back();
+        MPI_Isend(u.msg, 3, MPI_DOUBLE, dest, tag, comm, &u.req);
+        ++stats.sent;
+    };
+    // Забираем пришедшие обновления от соседа src; wait_last - ждать, пока не придёт последнее
+    bool done_left = false, done_right = false;
+    auto drain = [&](int src, int tag, double& ghost, bool& done, bool wait_last) {
+        while (!done) {
+            int flag = 0;
+            MPI_Iprobe(src, tag, comm, &flag, MPI_STATUS_IGNORE);
+            if (!flag && !wait_last) return;
+            double msg[3];
+            MPI_Recv(msg, 3, MPI_DOUBLE, src, tag, comm, MPI_STATUS_IGNORE);
+            ghost = msg[0];
+            if (msg[2] != 0.0) done = true;
+            else latency_hist_add(stats.latencies, stream_clock() - msg[1]);
+        }
+    };
+    auto reap = [&]() {
+        in_flight.remove_if([](Update& u) {
+            int flag = 0;
+            MPI_Test(&u.req, &flag, MPI_STATUS_IGNORE);
+            return flag != 0;
+        });
+    };
+
+    for (bool more = true; more; ) {
+        more = false;
+        double arrived = stream_clock();
+        for (int i = 0; i < n; ++i) {
+            long long nb = std::min(batch, my_counts[i] - seen[i]);
+            if (nb <= 0) continue;
+            long long first = local_displ + my_offsets[i] + seen[i];
+            // порция приходит: генерируется или читается из файла
+            if (!file_input) {
+                philox_fill_nuts(opt.seed, static_cast<std::uint64_t>(first), piece.data(), static_cast<std::size_t>(nb),
+                                 NUT_MASS_MIN, NUT_MASS_MAX);
+            } else {
+                MPI_Offset pos = static_cast<MPI_Offset>(NUT_BAG_HEADER_SIZE) + first * elem;
+                if (dtype == NUT_BAG_F32) {
+                    MPI_File_read_at(fh, pos, piece_f32.data(), static_cast<int>(nb), MPI_FLOAT, MPI_STATUS_IGNORE);
+                    std::copy(piece_f32.begin(), piece_f32.begin() + nb, piece.begin());
+                } else {
+                    MPI_File_read_at(fh, pos, piece.data(), static_cast<int>(nb), MPI_DOUBLE, MPI_STATUS_IGNORE);
+                }
+            }
+            arrived = stream_clock();
+            if (sketches != nullptr) nut_sketch_add(sketches[i], piece.data(), static_cast<std::size_t>(nb));
+
+            double mb = kernel(piece.data(), static_cast<std::size_t>(nb)) / static_cast<double>(nb);
+            double m2b = 0.0;
+            for (long long k = 0; k < nb; ++k) m2b += (piece[k] - mb) * (piece[k] - mb);
+            double na = static_cast<double>(seen[i]), nbd = static_cast<double>(nb);
+            double delta = mb - means[i];
+            means[i] += delta * nbd / (na + nbd);
+            m2[i] += m2b + delta * delta * na * nbd / (na + nbd);
+            seen[i] += nb;
+            if (seen[i] < my_counts[i]) more = true;
+        }
+        ++stats.epochs;
+
+        // крайние белки блока: сообщаем соседним процессам, если средняя заметно изменилась
+        auto maybe_send = [&](double value, double& last_sent, int dest, int tag) {
+            if (std::isnan(last_sent) || std::fabs(value - last_sent) > opt.stream_threshold) {
+                send_update(value, arrived, false, dest, tag);
+                last_sent = value;
+            } else {
+                ++stats.skipped;
+            }
+        };
+        maybe_send(means.front(), sent_first, left, 1);
+        maybe_send(means.back(), sent_last, right, 0);
+        drain(left, 0, ghost_left, done_left, false);
+        drain(right, 1, ghost_right, done_right, false);
+        reap();
+    }
+
+    // итоговые средние и ожидание итоговых от соседей
+    send_update(means.front(), stream_clock(), true, left, 1);
+    send_update(means.back(), stream_clock(), true, right, 0);
+    drain(left, 0, ghost_left, done_left, true);
+    drain(right, 1, ghost_right, done_right, true);
+    for (Update& u : in_flight) MPI_Wait(&u.req, MPI_STATUS_IGNORE);
+    stats.sent -= 2; // итоговые сообщения - не обновления
+    if (fh != MPI_FILE_NULL) MPI_File_close(&fh);
+    return stats;
+}
+
+// Наибольший кусок, который пересылается одним MPI-вызовом с int-счётчиком
+const long long MAX_INT_COUNT = std::numeric_limits<int>::max();
+
+// Рассылка мешка с 64-битными счётчиками и смещениями (мешок может быть больше 2^31 орехов).
+// В MPI-4 есть MPI_Scatterv_c с MPI_Count. В MPI-3, если всё помещается в int, это обычный
+// MPI_Scatterv, иначе root рассылает куски двухточечными сообщениями не длиннее max_message.
+// total - общее число элементов (известно всем процессам, по нему все выбирают один и тот же путь;
+// достаточно одинаковой у всех верхней границы). T и type - тип элемента: double или байты сжатого формата.
+// max_message < MAX_INT_COUNT (--max-message) включает двухточечный путь всегда, и в MPI-4 тоже:
+// так его можно проверить на маленьком мешке.
+template <typename T>
+void scatter_nuts(const T* nuts, const std::vector<long long>& counts, const std::vector<long long>& displs,
+                  T* recv, long long recv_count, long long total, MPI_Datatype type, int root, MPI_Comm comm,
+                  long long max_message = MAX_INT_COUNT) {
+    int size = 0, rank = 0;
+    MPI_Comm_size(comm, &size);
+    MPI_Comm_rank(comm, &rank);
+    const bool forced = max_message < MAX_INT_COUNT;
+#if MPI_VERSION >= 4
+    (void)total;
+    if (!forced) {
+        std::vector<MPI_Count> c_counts(counts.begin(), counts.end());
+        std::vector<MPI_Aint>  c_displs(displs.begin(), displs.end());
+        MPI_Scatterv_c(nuts, rank == root ? c_counts.data() : nullptr, rank == root ? c_displs.data() : nullptr, type,
+                       recv, static_cast<MPI_Count>(recv_count), type, root, comm);
+        return;
+    }
+#else
+    if (!forced && total <= MAX_INT_COUNT) {
+        std::vector<int> i_counts(counts.begin(), counts.end());
+        std::vector<int> i_displs(displs.begin(), displs.end());
+        MPI_Scatterv(nuts, rank == root ? i_counts.data() : nullptr, rank == root ? i_displs.data() : nullptr, type,
+                     recv, static_cast<int>(recv_count), type, root, comm);
+        return;
+    }
+#endif
+    if (rank == root) {
+        std::vector<MPI_Request> reqs;
+        for (int r = 0; r < size; ++r) {
+            const T* src = nuts + displs[r];
+            if (r == root) {
+                std::copy(src, src + counts[r], recv);
+                continue;
+            }
+            for (long long off = 0; off < counts[r]; off += max_message) {
+                int n = static_cast<int>(std::min(max_message, counts[r] - off));
+                reqs.emplace_back();
+                MPI_Isend(src + off, n, type, r, 0, comm, &reqs.back());
+            }
+        }
+        MPI_Waitall(static_cast<int>(reqs.size()), reqs.data(), MPI_STATUSES_IGNORE);
+    } else {
+        for (long long off = 0; off < recv_count; off += max_message) {
+            int n = static_cast<int>(std::min(max_message, recv_count - off));
+            MPI_Recv(recv + off, n, type, root, 0, comm, MPI_STATUS_IGNORE);
+        }
+    }
+}
+
+// Конвейерная рассылка мешка кусками по chunk орехов на процесс за раунд.
+// Раунд k+1 уже летит (MPI_Iscatterv в один из двух буферов), пока consume
+// обрабатывает раунд k, поэтому время до результата близко к max(передача, счёт),
+// а не к их сумме, и на процессе хранится только 2 * chunk орехов.
+// consume(ptr, first, n) получает орехи с номерами [first, first + n) внутри куска процесса.
+// Раунд не длиннее chunk <= INT_MAX, так что max_message здесь только выбирает двухточечный путь.
+template <typename Consume>
+void scatter_nuts_pipelined(const double* nuts, const std::vector<long long>& counts, const std::vector<long long>& displs,
+                            long long recv_count, long long total, long long chunk, int root, MPI_Comm comm,
+                            long long max_message, Consume consume) {
+    int size = 0, rank = 0;
+    MPI_Comm_size(comm, &size);
+    MPI_Comm_rank(comm, &rank);
+
+    // Число раундов одинаково у всех: по самому большому куску
+    long long max_count = 0;
+    MPI_Allreduce(&recv_count, &max_count, 1, MPI_LONG_LONG, MPI_MAX, comm);
+    long long rounds = (max_count + chunk - 1) / chunk;
+
+    // буфер не больше самого большого куска процесса
+    std::size_t buf_size = static_cast<std::size_t>(std::min(chunk, max_count));
+    std::vector<double> buf[2] = { std::vector<double>(buf_size), std::vector<double>(buf_size) };
+    // счётчики и смещения раунда должны жить, пока раунд не завершится
+    std::vector<long long> round_counts[2], round_displs[2];
+#if MPI_VERSION >= 4
+    std::vector<MPI_Count> c_counts[2];
+    std::vector<MPI_Aint>  c_displs[2];
+    (void)total;
+    const bool p2p = max_message < MAX_INT_COUNT;
+#else
+    std::vector<int> i_counts[2], i_displs[2];
+    // смещения не помещаются в int - рассылаем двухточечно
+    const bool p2p = total > MAX_INT_COUNT || max_message < MAX_INT_COUNT;
+#endif
+    std::vector<MPI_Request> reqs[2];
+
+    auto my_round_count = [&](long long k) {
+        return std::max(0LL, std::min(chunk, recv_count - k * chunk));
+    };
+
+    auto post_round = [&](long long k) {
+        int b = static_cast<int>(k % 2);
+        reqs[b].clear();
+        if (rank == root) {
+            round_counts[b].resize(size);
+            round_displs[b].resize(size);
+            for (int r = 0; r < size; ++r) {
+                round_counts[b][r] = std::max(0LL, std::min(chunk, counts[r] - k * chunk));
+                round_displs[b][r] = displs[r] + std::min(counts[r], k * chunk);
+            }
+        }
+        int n = static_cast<int>(my_round_count(k));
+        if (!p2p) {
+#if MPI_VERSION >= 4
+            c_counts[b].assign(round_counts[b].begin(), round_counts[b].end());
+            c_displs[b].assign(round_displs[b].begin(), round_displs[b].end());
+            reqs[b].emplace_back();
+            MPI_Iscatterv_c(nuts, c_counts[b].data(), c_displs[b].data(), MPI_DOUBLE,
+                            buf[b].data(), n, MPI_DOUBLE, root, comm, &reqs[b].back());
+#else
+            i_counts[b].assign(round_counts[b].begin(), round_counts[b].end());
+            i_displs[b].assign(round_displs[b].begin(), round_displs[b].end());
+            reqs[b].emplace_back();
+            MPI_Iscatterv(nuts, i_counts[b].data(), i_displs[b].data(), MPI_DOUBLE,
+                          buf[b].data(), n, MPI_DOUBLE, root, comm, &reqs[b].back());
+#endif
+            return;
+        }
+        if (rank == root) {
+            for (int r = 0; r < size; ++r) {
+                if (round_counts[b][r] == 0) continue;
+                reqs[b].emplace_back();
+                if (r == root) {
+                    MPI_Irecv(buf[b].data(), n, MPI_DOUBLE, root, 0, comm, &reqs[b].back());
+                    reqs[b].emplace_back();
+                }
+                MPI_Isend(nuts + round_displs[b][r], static_cast<int>(round_counts[b][r]), MPI_DOUBLE,
+                          r, 0, comm, &reqs[b].back());
+            }
+        } else if (n > 0) {
+            reqs[b].emplace_back();
+            MPI_Irecv(buf[b].data(), n, MPI_DOUBLE, root, 0, comm, &reqs[b].back());
+        }
+    };
+
+    if (rounds > 0) post_round(0);
+    for (long long k = 0; k < rounds; ++k) {
+        int b = static_cast<int>(k % 2);
+        // Чтобы не смешать сообщения двух раундов в двухточечном режиме, следующий раунд
+        // начинаем после приёма текущего, но до его обработки
+        MPI_Waitall(static_cast<int>(reqs[b].size()), reqs[b].data(), MPI_STATUSES_IGNORE);
+        if (k + 1 < rounds) post_round(k + 1);
+        consume(buf[b].data(), k * chunk, my_round_count(k));
+    }
+}
+
+// Сколько орехов читается из файла одним вызовом MPI-IO
+const long long READ_PIECE = 1LL << 24;
+
+// Каждый процесс читает свой кусок мешка [first, first + count) коллективным MPI_File_read_at_all.
+// Файл читают все процессы сразу, root не участвует в пересылке данных.
+void read_nut_slice_mpiio(MPI_Comm comm, const std::string& path, std::uint32_t dtype,
+                          long long first, long long count, double* out) {
+    MPI_File fh;
+    if (MPI_File_open(comm, path.c_str(), MPI_MODE_RDONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+        std::cerr << "Ошибка: MPI_File_open не смог открыть " << path << std::endl;
+        MPI_Abort(comm, 3);
+    }
+    const MPI_Offset elem = static_cast<MPI_Offset>(nut_bag_elem_size(dtype));
+
+    // чтение коллективное, поэтому число вызовов одинаково у всех: по самому большому куску
+    long long max_count = 0;
+    MPI_Allreduce(&count, &max_count, 1, MPI_LONG_LONG, MPI_MAX, comm);
+    std::vector<float> piece_f32(dtype == NUT_BAG_F32 ? std::min(READ_PIECE, count) : 0);
+
+    for (long long off = 0; off < max_count; off += READ_PIECE) {
+        int n = static_cast<int>(std::max(0LL, std::min(READ_PIECE, count - off)));
+        MPI_Offset pos = static_cast<MPI_Offset>(NUT_BAG_HEADER_SIZE) + (first + off) * elem;
+        if (dtype == NUT_BAG_F32) {
+            MPI_File_read_at_all(fh, pos, piece_f32.data(), n, MPI_FLOAT, MPI_STATUS_IGNORE);
+            std::copy(piece_f32.begin(), piece_f32.begin() + n, out + off);
+        } else {
+            MPI_File_read_at_all(fh, pos, out + off, n, MPI_DOUBLE, MPI_STATUS_IGNORE);
+        }
+    }
+    MPI_File_close(&fh);
+}
+
+// Файл мешка, отображённый в память (быстрый путь для запуска на одном узле:
+// страницы файла общие у всех процессов узла через page cache)
+struct MappedBag {
+    void* base = MAP_FAILED;
+    std::size_t length = 0;
+
+    ~MappedBag() {
+        if (base != MAP_FAILED) munmap(base, length);
+    }
+
+    bool open(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            return false;
+        }
+        length = static_cast<std::size_t>(st.st_size);
+        base = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        return base != MAP_FAILED;
+    }
+
+    const char* data() const { return static_cast<const char*>(base) + NUT_BAG_HEADER_SIZE; }
+};
+
+// Мешок в общей памяти узла (--dist shm). Процессы узла (MPI_COMM_TYPE_SHARED) делят одно
+// окно MPI_Win_allocate_shared: память выделяет лидер узла (node rank 0), остальные получают
+// указатель через MPI_Win_shared_query и читают свои куски прямо из него, без копии.
+// Между узлами мешок идёт от root только лидерам (коммуникатор leaders), по копии на узел.
+// Окно открыто в пассивном режиме (MPI_Win_lock_all): после записи MPI_Win_sync и барьер узла
+// делают её видимой остальным процессам узла.
+struct SharedBag {
+    MPI_Comm node = MPI_COMM_NULL;    // процессы одного узла, в порядке номеров в comm
+    MPI_Comm leaders = MPI_COMM_NULL; // лидеры узлов (только у лидеров), root - лидер номер 0
+    MPI_Win win = MPI_WIN_NULL;
+    double* base = nullptr;           // начало окна узла
+    int node_rank = 0;
+    int node_size = 1;
+    int num_nodes = 1;
+
+    // group_size > 0 - вместо настоящих узлов группы по group_size процессов подряд
+    // (на одной машине вся память общая, так можно проверить путь через несколько узлов)
+    void split(MPI_Comm comm, int group_size) {
+        int rank = 0;
+        MPI_Comm_rank(comm, &rank);
+        if (group_size > 0) {
+            MPI_Comm_split(comm, rank / group_size, rank, &node);
+        } else {
+            MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &node);
+        }
+        MPI_Comm_rank(node, &node_rank);
+        MPI_Comm_size(node, &node_size);
+        MPI_Comm_split(comm, node_rank == 0 ? 0 : MPI_UNDEFINED, rank, &leaders);
+        int is_leader = (node_rank == 0);
+        MPI_Allreduce(&is_leader, &num_nodes, 1, MPI_INT, MPI_SUM, comm);
+    }
+
+    // Коллективно по узлу: лидер выделяет count масс, остальные - ничего
+    void allocate(long long count) {
+        MPI_Aint bytes = (node_rank == 0) ? static_cast<MPI_Aint>(count) * static_cast<MPI_Aint>(sizeof(double)) : 0;
+        void* mine = nullptr;
+        MPI_Win_allocate_shared(bytes, sizeof(double), MPI_INFO_NULL, node, &mine, &win);
+        MPI_Aint size = 0;
+        int disp_unit = 0;
+        MPI_Win_shared_query(win, 0, &size, &disp_unit, &base);
+        MPI_Win_lock_all(MPI_MODE_NOCHECK, win);
+    }
+
+    // Записанное в окно становится видно всем процессам узла
+    void publish() {
+        MPI_Win_sync(win);
+        MPI_Barrier(node);
+        MPI_Win_sync(win);
+    }
+
+    // Коллективно по узлу; вызывать до MPI_Finalize
+    void release() {
+        if (win != MPI_WIN_NULL) {
+            MPI_Win_unlock_all(win);
+            MPI_Win_free(&win);
+        }
+        if (leaders != MPI_COMM_NULL) MPI_Comm_free(&leaders);
+        if (node != MPI_COMM_NULL) MPI_Comm_free(&node);
+    }
+};
+
+// Несколько узлов в --dist shm: root отправляет каждому лидеру узла куски его процессов
+// (одна копия на узел), лидер принимает их прямо в окно. Если процессы узла идут в comm
+// подряд, их куски в мешке тоже подряд и отправляются без упаковки.
+// Возвращает (на root) число байт, ушедших на другие узлы.
+long long send_bag_to_leaders(MPI_Comm comm, const std::vector<double>& nuts, const std::vector<long long>& sendcounts,
+                              const std::vector<long long>& displs, const SharedBag& shared, long long node_total, long long total,
+                              long long max_message) {
+    int size = 0, rank = 0;
+    MPI_Comm_size(comm, &size);
+    MPI_Comm_rank(comm, &rank);
+    // номер (в comm) лидера узла каждого процесса
+    int my_leader = rank;
+    MPI_Bcast(&my_leader, 1, MPI_INT, 0, shared.node);
+    std::vector<int> leader_of(rank == 0 ? size : 0);
+    MPI_Gather(&my_leader, 1, MPI_INT, leader_of.data(), 1, MPI_INT, 0, comm);
+    if (shared.leaders == MPI_COMM_NULL) return 0;
+
+    std::vector<long long> counts(shared.num_nodes, 0), node_displs(shared.num_nodes, 0);
+    std::vector<double> packed;
+    const double* src = nuts.data();
+    long long sent = 0;
+    if (rank == 0) {
+        // лидеры в leaders идут по возрастанию номеров, как и их процессы внутри узла
+        std::vector<int> leaders(leader_of);
+        std::sort(leaders.begin(), leaders.end());
+        leaders.erase(std::unique(leaders.begin(), leaders.end()), leaders.end());
+        bool contiguous = true;
+        for (int r = 0; r < size; ++r) {
+            int l = static_cast<int>(std::lower_bound(leaders.begin(), leaders.end(), leader_of[r]) - leaders.begin());
+            if (r > 0 && leader_of[r] != leader_of[r - 1] && counts[l] > 0) contiguous = false;
+            if (counts[l] == 0) node_displs[l] = displs[r];
+            counts[l] += sendcounts[r];
+        }
+        if (!contiguous) {
+            packed.reserve(static_cast<std::size_t>(total));
+            for (int l = 0; l < shared.num_nodes; ++l) {
+                node_displs[l] = static_cast<long long>(packed.size());
+                for (int r = 0; r < size; ++r) {
+                    if (leader_of[r] != leaders[l]) continue;
+                    packed.insert(packed.end(), nuts.begin() + displs[r], nuts.begin() + displs[r] + sendcounts[r]);
+                }
+            }
+            src = packed.data();
+        }
+        sent = (total - counts[0]) * static_cast<long long>(sizeof(double));
+    }
+    scatter_nuts(src, counts, node_displs, shared.base, node_total, total, MPI_DOUBLE, 0, shared.leaders, max_message);
+    return sent;
+}
+
+// Записи белок процесса пишутся в общий файл по смещению offset коллективным MPI_File_write_at_all.
+// Запись - производный тип из record_len байт, поэтому счётчик в вызове - число записей, а не байт,
+// и не упирается в int, сколько бы белок ни было у процесса.
+// total_size - итоговый размер файла: старый файл обрезается, чтобы в нём не осталось хвоста.
+// header (только у root) пишется в начало файла отдельно.
+void write_records_at(MPI_Comm comm, const std::string& path, const std::string& header,
+                      const std::string& records, MPI_Offset record_len, MPI_Offset offset, MPI_Offset total_size) {
+    MPI_File fh;
+    if (MPI_File_open(comm, path.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+        std::cerr << "Ошибка: MPI_File_open не смог открыть " << path << " на запись" << std::endl;
+        MPI_Abort(comm, 3);
+    }
+    MPI_File_set_size(fh, total_size);
+    if (!header.empty()) {
+        MPI_File_write_at(fh, 0, header.data(), static_cast<int>(header.size()), MPI_CHAR, MPI_STATUS_IGNORE);
+    }
+    MPI_Datatype record_type;
+    MPI_Type_contiguous(static_cast<int>(record_len), MPI_CHAR, &record_type);
+    MPI_Type_commit(&record_type);
+    long long count = static_cast<long long>(records.size()) / record_len;
+    MPI_File_write_at_all(fh, offset, records.data(), static_cast<int>(count), record_type, MPI_STATUS_IGNORE);
+    MPI_Type_free(&record_type);
+    MPI_File_close(&fh);
+}
+
+// Фазы программы, время которых замеряется для --profile
+enum Phase {
+    PHASE_GENERATE,  // генерация масс (root или каждая белка на месте)
+    PHASE_READ,      // чтение своего куска из файла мешка
+    PHASE_PARTITION, // разрезы и рассылка числа орехов
+    PHASE_SCATTER,   // рассылка масс
+    PHASE_COMPUTE,   // суммирование
+    PHASE_EXCHANGE,  // обмен средними с соседками
+    PHASE_TRADE,     // раунды обмена массой (--rounds)
+    PHASE_STREAM,    // потоковый режим: порции, статистика и обновления соседей вперемешку (--stream)
+    PHASE_OUTPUT,    // вывод
+    PHASE_COUNT
+};
+const char* const PHASE_NAMES[PHASE_COUNT] = {
+    "generate", "read", "partition", "scatter", "compute", "exchange", "trade", "stream", "output"
+};
+
+// Время фаз на одном процессе: mark(phase) относит время с прошлой отметки к фазе phase
+struct PhaseTimer {
+    double times[PHASE_COUNT] = {};
+    double last = MPI_Wtime();
+
+    void mark(Phase phase) {
+        double now = MPI_Wtime();
+        times[phase] += now - last;
+        last = now;
+    }
+};
+
+// Строка в кавычках для JSON: кавычки, обратная косая и управляющие символы экранируются
+// (путь --input может быть любым)
+std::string json_string(const std::string& str) {
+    std::ostringstream o;
+    o << '"';
+    for (unsigned char c : str) {
+        if (c == '"' || c == '\\') o << '\\' << c;
+        else if (c == '\n') o << "\\n";
+        else if (c == '\t') o << "\\t";
+        else if (c < 0x20) o << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec;
+        else o << c;
+    }
+    o << '"';
+    return o.str();
+}
+
+// Сводим время фаз всех процессов на root (min / max / mean) и печатаем отчёт в JSON.
+// Дисбаланс фазы - max / mean: 1 - идеально ровно, P - всю работу сделал один процесс.
+// Связь (communication) - разбиение, рассылка и обмен вместе; в них входит и ожидание
+// медленных процессов, поэтому перекос счёта виден и там.
+// squirrel_skew - перекос разбиения по белкам (max / mean, известен только root).
+// Для --rounds в отчёт попадает время раунда, для --stream - задержка обновлений, по всем процессам
+// (сводки LatencyHist: квантили с точностью ~4%, min / mean / max точные).
+void report_profile(MPI_Comm comm, const PhaseTimer& timer, long long local_count,
+                    const Options& opt, long long total_nuts, long long bytes_scattered, double squirrel_skew,
+                    const TradeStats& trade, const StreamStats& stream) {
+    int size = 0, rank = 0;
+    MPI_Comm_size(comm, &size);
+    MPI_Comm_rank(comm, &rank);
+
+    // фазы, затем связь, всё время и число орехов процесса
+    const int N = PHASE_COUNT + 3;
+    double local[N];
+    double total_time = 0.0;
+    for (int p = 0; p < PHASE_COUNT; ++p) {
+        local[p] = timer.times[p];
+        total_time += timer.times[p];
+    }
+    local[PHASE_COUNT]     = timer.times[PHASE_PARTITION] + timer.times[PHASE_SCATTER] + timer.times[PHASE_EXCHANGE];
+    local[PHASE_COUNT + 1] = total_time;
+    local[PHASE_COUNT + 2] = static_cast<double>(local_count);
+
+    double mins[N], maxs[N], sums[N];
+    MPI_Reduce(local, mins, N, MPI_DOUBLE, MPI_MIN, 0, comm);
+    MPI_Reduce(local, maxs, N, MPI_DOUBLE, MPI_MAX, 0, comm);
+    MPI_Reduce(local, sums, N, MPI_DOUBLE, MPI_SUM, 0, comm);
+    // сводка времён раундов всех процессов: фиксированный блок, сколько бы ни было раундов
+    MPI_Datatype latency_type;
+    MPI_Type_contiguous(static_cast<int>(sizeof(LatencyHist)), MPI_BYTE, &latency_type);
+    MPI_Type_commit(&latency_type);
+    MPI_Op latency_op;
+    MPI_Op_create(&latency_merge_op, 1, &latency_op);
+    LatencyHist round_times, latencies;
+    MPI_Reduce(&trade.round_times, &round_times, 1, latency_type, latency_op, 0, comm);
+    // задержки обновлений потокового режима всех процессов - так же
+    MPI_Reduce(&stream.latencies, &latencies, 1, latency_type, latency_op, 0, comm);
+    MPI_Op_free(&latency_op);
+    MPI_Type_free(&latency_type);
+    long long stream_totals[3] = { stream.epochs, stream.sent, stream.skipped }, stream_sums[3] = { 0, 0, 0 };
+    MPI_Reduce(stream_totals, stream_sums, 3, MPI_LONG_LONG, MPI_SUM, 0, comm);
+    long long max_epochs = 0;
+    MPI_Reduce(&stream.epochs, &max_epochs, 1, MPI_LONG_LONG, MPI_MAX, 0, comm);
+    if (rank != 0) return;
+
+    // min / mean / p50 / p99 / max по сводке задержек
+    auto hist_stats = [](const LatencyHist& h) {
+        std::ostringstream o;
+        o << std::setprecision(9) << "{\"min\": " << (h.count ? h.min : 0.0)
+          << ", \"mean\": " << (h.count ? h.sum / h.count : 0.0)
+          << ", \"p50\": " << latency_hist_quantile(h, 0.5) << ", \"p99\": " << latency_hist_quantile(h, 0.99)
+          << ", \"max\": " << (h.count ? h.max : 0.0) << "}";
+        return o.str();
+    };
+
+    auto stats = [&](int k) {
+        std::ostringstream o;
+        o << std::setprecision(9)
+          << "{\"min\": " << mins[k] << ", \"max\": " << maxs[k] << ", \"mean\": " << sums[k] / size << "}";
+        return o.str();
+    };
+    auto imbalance = [&](int k) {
+        double mean = sums[k] / size;
+        return mean > 0.0 ? maxs[k] / mean : 1.0;
+    };
+
+    std::ostringstream json;
+    json << std::setprecision(9) << "{\n"
+         << "  \"ranks\": " << size << ",\n"
+         << "  \"squirrels\": " << opt.num_squirrels << ",\n"
+         << "  \"nuts\": " << total_nuts << ",\n"
+         << "  \"bytes_scattered\": " << bytes_scattered << ",\n"
+         << "  \"config\": {\"gen\": " << json_string(opt.gen) << ", \"dist\": " << json_string(opt.dist)
+         << ", \"input\": " << json_string(opt.input) << ", \"exchange\": " << json_string(opt.exchange)
+         << ", \"sum\": " << json_string(opt.sum) << ", \"scatter_chunk\": " << opt.scatter_chunk
+         << ", \"output\": " << json_string(opt.output) << ", \"partition\": " << json_string(opt.partition)
+         << ", \"partition_mode\": " << json_string(opt.partition_mode)
+         << ", \"wire\": " << json_string(opt.wire) << ", \"sketch\": " << json_string(opt.sketch) << "},\n"
+         << "  \"phases\": {\n";
+    for (int p = 0; p < PHASE_COUNT; ++p) {
+        json << "    \"" << PHASE_NAMES[p] << "\": " << stats(p) << (p + 1 < PHASE_COUNT ? ",\n" : "\n");
+    }
+    json << "  },\n"
+         << "  \"communication\": " << stats(PHASE_COUNT) << ",\n"
+         << "  \"total\": " << stats(PHASE_COUNT + 1) << ",\n"
+         << "  \"nuts_per_rank\": " << stats(PHASE_COUNT + 2) << ",\n"
+         << "  \"imbalance\": {\"compute\": " << imbalance(PHASE_COMPUTE)
+         << ", \"communication\": " << imbalance(PHASE_COUNT)
+         << ", \"nuts\": " << imbalance(PHASE_COUNT + 2)
+         << ", \"squirrels\": " << squirrel_skew << "}";
+    if (opt.rounds > 0) {
+        json << ",\n  \"trade\": {\"rounds\": " << trade.rounds
+             << ", \"converged\": " << (trade.converged ? "true" : "false")
+             << ", \"residual\": " << trade.residual
+             << ", \"rate\": " << opt.trade_rate << ",\n"
+             << "    \"round_latency\": " << hist_stats(round_times) << "}";
+    }
+    if (opt.stream > 0) {
+        json << ",\n  \"stream\": {\"batch\": " << opt.stream << ", \"threshold\": " << opt.stream_threshold
+             << ", \"epochs\": " << max_epochs << ", \"updates_sent\": " << stream_sums[1]
+             << ", \"updates_skipped\": " << stream_sums[2] << ",\n"
+             << "    \"update_latency\": " << hist_stats(latencies) << "}";
+    }
+    json << "\n}\n";
+
+    if (opt.profile_out.empty()) {
+        std::cout << json.str() << std::flush;
+    } else {
+        std::ofstream fout(opt.profile_out);
+        fout << json.str();
+        if (!fout) std::cerr << "Ошибка: не удалось записать отчёт " << opt.profile_out << std::endl;
+    }
+}
+
+// Собираем текст всех процессов на root и печатаем его в порядке номеров процессов
+void print_in_rank_order(const std::string& text, int root, MPI_Comm comm) {
+    int size = 0, rank = 0;
+    MPI_Comm_size(comm, &size);
+    MPI_Comm_rank(comm, &rank);
+
+    int len = static_cast<int>(text.size());
+    std::vector<int> lens(rank == root ? size : 0);
+    MPI_Gather(&len, 1, MPI_INT, lens.data(), 1, MPI_INT, root, comm);
+
+    std::vector<int> offsets(lens.size(), 0);
+    std::string all;
+    if (rank == root) {
+        for (int r = 1; r < size; ++r) offsets[r] = offsets[r-1] + lens[r-1];
+        all.resize(static_cast<std::size_t>(offsets.back()) + lens.back());
+    }
+    MPI_Gatherv(text.data(), len, MPI_CHAR, &all[0], lens.data(), offsets.data(), MPI_CHAR, root, comm);
+    if (rank == root) {
+        std::cout << all << std::flush;
+    }
+}
+
+SquirrelsResult run_squirrels(MPI_Comm comm, const Options& config) {
+    int size = 0;
+    int rank = 0;
+    MPI_Comm_size(comm, &size);
+    MPI_Comm_rank(comm, &rank);
+
+    Options opt = config; // число орехов может прийти из заголовка файла мешка
+    SquirrelsResult result;
+    const bool local_gen = (opt.dist == "local");
+    const bool file_input = !opt.input.empty();
+    const bool distributed = (opt.partition_mode == "distributed");
+
+    // Мешок из файла: root читает заголовок и сообщает всем число орехов и тип масс
+    std::uint32_t bag_dtype = NUT_BAG_F64;
+    if (file_input) {
+        NutBagHeader header;
+        std::string bag_err;
+        long long bag_info[2] = { -1, 0 }; // число орехов (-1 - ошибка) и тип масс
+        if (rank == 0) {
+            if (read_nut_bag_header(opt.input, header, bag_err)) {
+                bag_info[0] = static_cast<long long>(header.count);
+                bag_info[1] = header.dtype;
+            } else {
+                std::cerr << "Ошибка: " << bag_err << std::endl;
+            }
+        }
+        MPI_Bcast(bag_info, 2, MPI_LONG_LONG, 0, comm);
+        if (bag_info[0] < 0) {
+            result.status = 1;
+            return result;
+        }
+        opt.total_nuts = bag_info[0];
+        bag_dtype = static_cast<std::uint32_t>(bag_info[1]);
+    }
+
+    const int NUM_SQUIRRELS = opt.num_squirrels;                   // количество белок
+    const long long TOTAL_NUTS = opt.total_nuts;                   // количество орехов в мешке
+
+    // Каждому процессу нужна хотя бы одна белка
+    if (size > NUM_SQUIRRELS) {
+        if (rank == 0) {
+            std::cerr << "Ошибка: процессов (" << size
+                      << ") больше, чем белок (" << NUM_SQUIRRELS << ")" << std::endl;
+        }
+        result.status = 1;
+        return result;
+    }
+
+    PhaseTimer timer;
+    const nut_sum_fn sum_kernel = nut_sum_kernel(opt.sum);
+
+    // Какие белки живут в каком процессе
+    std::vector<int> block_counts, block_firsts;
+    squirrel_blocks(size, NUM_SQUIRRELS, block_counts, block_firsts);
+    const int my_first   = block_firsts[rank];
+    const int my_squirrels = block_counts[rank];
+
+    // Для --partition weighted root нужны веса процессов: из файла или замер на каждом процессе
+    std::vector<double> rank_weights; // только на root
+    if (opt.partition == "weighted") {
+        int weights_ok = 1;
+        if (opt.weights.empty()) {
+            double capacity = measure_rank_capacity(sum_kernel);
+            rank_weights.resize(rank == 0 ? size : 0);
+            MPI_Gather(&capacity, 1, MPI_DOUBLE, rank_weights.data(), 1, MPI_DOUBLE, 0, comm);
+        } else if (rank == 0) {
+            std::string weights_err;
+            if (!read_rank_weights(opt.weights, size, rank_weights, weights_err)) {
+                std::cerr << "Ошибка: " << weights_err << std::endl;
+                weights_ok = 0;
+            }
+        }
+        MPI_Bcast(&weights_ok, 1, MPI_INT, 0, comm);
+        if (!weights_ok) {
+            result.status = 1;
+            return result;
+        }
+        timer.mark(PHASE_PARTITION);
+    }
+
+    std::vector<double> nuts;                  // только на root: все массы
+    std::vector<long long> squirrel_counts;        // только на root: сколько орехов каждой белке
+    std::vector<long long> squirrel_displs;        // только на root: с какого ореха начинается кусок белки
+    std::vector<long long> sendcounts(size); // сколько орехов каждому процессу
+    std::vector<long long> displs(size);     // смещения для Scatterv
+
+    // --dist shm: на одном узле весь мешок сразу живёт в окне узла, и root генерирует прямо в него
+    SharedBag shared;
+    if (opt.dist == "shm") {
+        shared.split(comm, opt.node_size);
+        if (shared.num_nodes == 1) shared.allocate(TOTAL_NUTS);
+    }
+
+    // В распределённом режиме root ничего не генерирует и не разбивает
+    if (rank == 0 && !distributed) {
+        // Генератор для разрезов. В режиме mt19937 он же генерирует массы,
+        // поэтому разрезы берутся после всех масс (как было изначально)
+        std::mt19937 gen(static_cast<std::mt19937::result_type>(opt.seed));
+
+        // Заполнили массы орехов (в режимах local и --input каждая белка получает их сама)
+        // Массы пишутся в окно общей памяти (--dist shm на одном узле) или в вектор root
+        double* bag = shared.base;
+        if (!file_input && !local_gen && bag == nullptr) {
+            nuts.resize(TOTAL_NUTS);
+            bag = nuts.data();
+        }
+        if (file_input) {
+            // массы прочитают сами белки
+        } else if (opt.gen == "mt19937") {
+            std::uniform_real_distribution<double> dist(NUT_MASS_MIN, NUT_MASS_MAX);
+            for (long long i = 0; i < TOTAL_NUTS; ++i) bag[i] = dist(gen);
+        } else if (!local_gen) {
+            philox_fill_nuts(opt.seed, 0, bag, static_cast<std::size_t>(TOTAL_NUTS), NUT_MASS_MIN, NUT_MASS_MAX);
+        }
+        timer.mark(PHASE_GENERATE);
+
+        // Гарантируем минимум 1 орех каждой белке, остальное делим выбранной стратегией
+        squirrel_displs.resize(NUM_SQUIRRELS);
+        if (opt.partition == "even") {
+            partition_even(TOTAL_NUTS, NUM_SQUIRRELS, squirrel_counts);
+        } else if (opt.partition == "bounded-random") {
+            partition_bounded_random(TOTAL_NUTS, NUM_SQUIRRELS, opt.partition_cap, gen, squirrel_counts);
+        } else if (opt.partition == "weighted") {
+            // вес процесса делится поровну между его белками
+            std::vector<double> squirrel_weights(NUM_SQUIRRELS);
+            for (int r = 0; r < size; ++r) {
+                for (int i = 0; i < block_counts[r]; ++i) {
+                    squirrel_weights[block_firsts[r] + i] = rank_weights[r] / block_counts[r];
+                }
+            }
+            partition_weighted(TOTAL_NUTS, squirrel_weights, squirrel_counts);
+        } else {
+            partition_random(TOTAL_NUTS, NUM_SQUIRRELS, gen, squirrel_counts);
+        }
+
+        // Смещения кусков белок
+        squirrel_displs[0] = 0;
+        for (int i = 1; i < NUM_SQUIRRELS; ++i) squirrel_displs[i] = squirrel_displs[i-1] + squirrel_counts[i-1];
+
+        // Кусок процесса - подряд идущие куски его белок
+        for (int r = 0; r < size; ++r) {
+            displs[r] = squirrel_displs[block_firsts[r]];
+            sendcounts[r] = 0;
+            for (int i = 0; i < block_counts[r]; ++i) sendcounts[r] += squirrel_counts[block_firsts[r] + i];
+        }
+
+        // Проверка: сумма должна быть TOTAL_NUTS
+        long long sum = 0;
+        for (long long v : sendcounts) sum += v;
+        if (sum != TOTAL_NUTS) {
+            std::cerr << "Internal error: sum(sendcounts) != TOTAL_NUTS: " << sum << " vs " << TOTAL_NUTS << "\n";
+            MPI_Abort(comm, 2);
+        }
+    }
+
+    // Каждый процесс получает число орехов своих белок через Scatterv
+    // или в распределённом режиме находит их сам, а начало своего куска - префиксной суммой
+    std::vector<long long> my_counts(my_squirrels);
+    long long local_count = 0;
+    long long local_displ = 0;
+    if (distributed) {
+        partition_distributed(opt.partition, opt.seed, TOTAL_NUTS, NUM_SQUIRRELS, my_first, my_squirrels,
+                              my_counts.data());
+        for (long long c : my_counts) local_count += c;
+        MPI_Exscan(&local_count, &local_displ, 1, MPI_LONG_LONG, MPI_SUM, comm);
+        if (rank == 0) local_displ = 0; // у процесса 0 результат MPI_Exscan не определён
+        // Проверка: последний кусок должен закончиться ровно на TOTAL_NUTS
+        if (rank == size - 1 && local_displ + local_count != TOTAL_NUTS) {
+            std::cerr << "Internal error: sum(counts) != TOTAL_NUTS: " << local_displ + local_count
+                      << " vs " << TOTAL_NUTS << "\n";
+            MPI_Abort(comm, 2);
+        }
+    } else {
+        MPI_Scatterv(squirrel_counts.data(), block_counts.data(), block_firsts.data(), MPI_LONG_LONG,
+                     my_counts.data(), my_squirrels, MPI_LONG_LONG, 0, comm);
+        for (long long c : my_counts) local_count += c;
+    }
+
+    // Перекос разбиения по белкам (max / mean) на root: для итогов и отчёта
+    double squirrel_skew = 1.0;
+    if (opt.profile || opt.output == "summary") {
+        long long my_max = my_counts.empty() ? 0 : *std::max_element(my_counts.begin(), my_counts.end());
+        long long max_count = 0;
+        MPI_Reduce(&my_max, &max_count, 1, MPI_LONG_LONG, MPI_MAX, 0, comm);
+        if (TOTAL_NUTS > 0) squirrel_skew = static_cast<double>(max_count) * NUM_SQUIRRELS / TOTAL_NUTS;
+    }
+
+    // Начало куска каждой белки внутри куска процесса
+    std::vector<long long> my_offsets(my_squirrels, 0);
+    for (int i = 1; i < my_squirrels; ++i) my_offsets[i] = my_offsets[i-1] + my_counts[i-1];
+
+    // Суммарный вес каждой белки и (с --sketch hist) гистограмма её масс
+    std::vector<double> my_sums(my_squirrels, 0.0);
+    const bool sketching = (opt.sketch == "hist");
+    std::vector<NutSketch> my_sketches(sketching ? my_squirrels : 0);
+    timer.mark(PHASE_PARTITION);
+
+    // Соседние средние на краях блока: из потокового режима или из обмена после подсчёта
+    double ghost_left  = 0.0;
+    double ghost_right = 0.0;
+    StreamStats stream_stats;
+    std::vector<double> stream_means, stream_m2;
+    long long bytes_scattered = 0; // сколько байт масс разослал root (для отчёта)
+
+    if (opt.stream > 0) {
+        // Порции своих орехов генерируем или читаем на месте, как и в режимах local / --input
+        if (!distributed) {
+            MPI_Scatter(displs.data(), 1, MPI_LONG_LONG, &local_displ, 1, MPI_LONG_LONG, 0, comm);
+        }
+        timer.mark(PHASE_PARTITION);
+        stream_stats = stream_squirrels(comm, opt, file_input, bag_dtype, local_displ, my_counts, my_offsets,
+                                        sum_kernel, stream_means, stream_m2, ghost_left, ghost_right,
+                                        sketching ? my_sketches.data() : nullptr);
+        for (int i = 0; i < my_squirrels; ++i) my_sums[i] = stream_means[i] * static_cast<double>(my_counts[i]);
+        timer.mark(PHASE_STREAM);
+    } else if (opt.scatter_chunk > 0) {
+        // Конвейер: кусок раунда раскладываем по белкам, чьи орехи в него попали,
+        // и добавляем сумму каждой части к накопленной сумме белки
+        // время суммирования внутри конвейера считаем отдельно, остальное - рассылка
+        int sq = 0;
+        double consume_time = 0.0;
+        bytes_scattered = TOTAL_NUTS * static_cast<long long>(sizeof(double));
+        scatter_nuts_pipelined(nuts.data(), sendcounts, displs, local_count, TOTAL_NUTS, opt.scatter_chunk,
+                               0, comm, opt.max_message,
+                               [&](const double* chunk, long long first, long long n) {
+            double t0 = MPI_Wtime();
+            long long pos = 0;
+            while (pos < n) {
+                while (my_offsets[sq] + my_counts[sq] <= first + pos) ++sq;
+                long long take = std::min(n - pos, my_offsets[sq] + my_counts[sq] - (first + pos));
+                my_sums[sq] += sum_kernel(chunk + pos, static_cast<std::size_t>(take));
+                if (sketching) nut_sketch_add(my_sketches[sq], chunk + pos, static_cast<std::size_t>(take));
+                pos += take;
+            }
+            consume_time += MPI_Wtime() - t0;
+        });
+        timer.mark(PHASE_SCATTER);
+        timer.times[PHASE_SCATTER] -= consume_time;
+        timer.times[PHASE_COMPUTE] += consume_time;
+    } else {
+        // Принимаем свои орехи. local_data указывает на массы куска процесса:
+        // обычно это local_nuts, а при mmap файла с double - прямо страницы файла
+        std::vector<double> local_nuts;
+        const double* local_data = nullptr;
+        MappedBag mapped;
+        if (local_gen || file_input) {
+            // Рассылаем только смещение (если оно не найдено префиксной суммой),
+            // а массы своего куска генерируем или читаем на месте
+            if (!distributed) {
+                MPI_Scatter(displs.data(), 1, MPI_LONG_LONG, &local_displ, 1, MPI_LONG_LONG, 0, comm);
+            }
+            timer.mark(PHASE_PARTITION);
+            if (local_gen) {
+                local_nuts.resize(local_count);
+                philox_fill_nuts(opt.seed, static_cast<std::uint64_t>(local_displ), local_nuts.data(), local_nuts.size(),
+                                 NUT_MASS_MIN, NUT_MASS_MAX);
+                timer.mark(PHASE_GENERATE);
+            } else if (opt.io == "mmap") {
+                if (!mapped.open(opt.input)) {
+                    std::cerr << "Ошибка: не удалось отобразить в память " << opt.input << std::endl;
+                    MPI_Abort(comm, 3);
+                }
+                if (bag_dtype == NUT_BAG_F64) {
+                    local_data = reinterpret_cast<const double*>(mapped.data()) + local_displ;
+                } else {
+                    const float* src = reinterpret_cast<const float*>(mapped.data()) + local_displ;
+                    local_nuts.assign(src, src + local_count);
+                }
+            } else {
+                local_nuts.resize(local_count);
+                read_nut_slice_mpiio(comm, opt.input, bag_dtype, local_displ, local_count, local_nuts.data());
+            }
+            if (file_input) timer.mark(PHASE_READ);
+        } else if (opt.dist == "shm") {
+            // Куски процессов узла лежат в окне подряд, в порядке номеров процессов
+            std::vector<long long> node_counts(shared.node_size), node_offsets(shared.node_size, 0);
+            MPI_Allgather(&local_count, 1, MPI_LONG_LONG, node_counts.data(), 1, MPI_LONG_LONG, shared.node);
+            for (int r = 1; r < shared.node_size; ++r) node_offsets[r] = node_offsets[r - 1] + node_counts[r - 1];
+            if (shared.num_nodes > 1) {
+                long long node_total = node_offsets.back() + node_counts.back();
+                shared.allocate(node_total);
+                bytes_scattered = send_bag_to_leaders(comm, nuts, sendcounts, displs, shared, node_total, TOTAL_NUTS,
+                                                      opt.max_message);
+            }
+            shared.publish();
+            local_data = shared.base + node_offsets[shared.node_rank];
+            timer.mark(PHASE_SCATTER);
+        } else if (opt.wire != "f64") {
+            // Сжатая рассылка: root кодирует кусок каждого процесса отдельно (куски со своим масштабом
+            // начинаются с начала куска процесса), процесс раскодирует свой кусок перед суммированием
+            std::vector<unsigned char> wire;
+            std::vector<long long> wire_counts(size), wire_displs(size, 0);
+            if (rank == 0) {
+                for (int r = 0; r < size; ++r) {
+                    wire_counts[r] = static_cast<long long>(nut_wire_bytes(opt.wire, sendcounts[r]));
+                    if (r > 0) wire_displs[r] = wire_displs[r - 1] + wire_counts[r - 1];
+                }
+                wire.resize(static_cast<std::size_t>(wire_displs.back() + wire_counts.back()));
+                #pragma omp parallel for schedule(dynamic, 1)
+                for (int r = 0; r < size; ++r) {
+                    nut_wire_encode(opt.wire, nuts.data() + displs[r], sendcounts[r], wire.data() + wire_displs[r]);
+                }
+                bytes_scattered = static_cast<long long>(wire.size());
+            }
+            // граница общего числа байт, одинаковая у всех процессов (по ней выбирается способ рассылки)
+            long long wire_bound = static_cast<long long>(nut_wire_bytes(opt.wire, TOTAL_NUTS))
+                                 + size * static_cast<long long>(NUT_WIRE_CHUNK_HEADER);
+            std::vector<unsigned char> my_wire(nut_wire_bytes(opt.wire, local_count));
+            scatter_nuts(wire.data(), wire_counts, wire_displs, my_wire.data(), static_cast<long long>(my_wire.size()),
+                         wire_bound, MPI_BYTE, 0, comm, opt.max_message);
+            local_nuts.resize(local_count);
+            nut_wire_decode(opt.wire, my_wire.data(), local_count, local_nuts.data());
+            timer.mark(PHASE_SCATTER);
+        } else {
+            local_nuts.resize(local_count);
+            scatter_nuts(nuts.data(), sendcounts, displs, local_nuts.data(), local_count, TOTAL_NUTS,
+                         MPI_DOUBLE, 0, comm, opt.max_message);
+            bytes_scattered = TOTAL_NUTS * static_cast<long long>(sizeof(double));
+            timer.mark(PHASE_SCATTER);
+        }
+        if (local_data == nullptr) local_data = local_nuts.data();
+
+        // Белки процесса считаются в потоках
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (int i = 0; i < my_squirrels; ++i) {
+            const double* begin = local_data + my_offsets[i];
+            my_sums[i] = sum_kernel(begin, static_cast<std::size_t>(my_counts[i]));
+            if (sketching) nut_sketch_add(my_sketches[i], begin, static_cast<std::size_t>(my_counts[i]));
+        }
+        shared.release();
+        timer.mark(PHASE_COMPUTE);
+    }
+
+    // Средний вес каждой белки
+    std::vector<double> my_avgs(my_squirrels);
+    for (int i = 0; i < my_squirrels; ++i) {
+        my_avgs[i] = (my_counts[i] > 0) ? my_sums[i] / static_cast<double>(my_counts[i]) : 0.0;
+    }
+    if (opt.stream > 0) my_avgs = stream_means;
+
+    // Раунды обмена массой: средние выравниваются, дальше выводятся уже они
+    TradeStats trade;
+    if (opt.rounds > 0) {
+        trade = trade_rounds(comm, opt, my_avgs);
+        timer.mark(PHASE_TRADE);
+    }
+
+    // Рассказываем средние соседкам: между процессами - только крайние белки блока.
+    // Потоковый режим уже закончился итоговыми средними соседей, если их не изменили раунды
+    if (opt.stream == 0 || opt.rounds > 0) {
+        exchange_with_neighbours(opt.exchange, comm, NUM_SQUIRRELS, my_avgs, ghost_left, ghost_right);
+        timer.mark(PHASE_EXCHANGE);
+    }
+
+    // Гистограммы: соседкам - крайние белки блока, на root - сумма всех через свою MPI_Op.
+    // Пересылается только размер гистограммы, а не массы
+    NutSketch sketch_left, sketch_right, sketch_all;
+    if (sketching) {
+        MPI_Datatype sketch_type;
+        MPI_Type_contiguous(static_cast<int>(sizeof(NutSketch)), MPI_BYTE, &sketch_type);
+        MPI_Type_commit(&sketch_type);
+        MPI_Op sketch_op;
+        MPI_Op_create(&sketch_merge_op, 1, &sketch_op);
+        exchange_sketches(comm, sketch_type, my_sketches, sketch_left, sketch_right);
+        NutSketch local_all;
+        for (const auto& sk : my_sketches) nut_sketch_merge(sk, local_all);
+        MPI_Reduce(&local_all, &sketch_all, 1, sketch_type, sketch_op, 0, comm);
+        MPI_Op_free(&sketch_op);
+        MPI_Type_free(&sketch_type);
+        timer.mark(PHASE_EXCHANGE);
+
+        if (rank == 0 && !opt.sketch_out.empty()) {
+            std::ofstream fout(opt.sketch_out);
+            fout << "lo,hi,count\n" << std::setprecision(17);
+            for (int b = 0; b < NUT_SKETCH_BINS; ++b) {
+                fout << NUT_MASS_MIN + b * nut_sketch_bin_width() << "," << NUT_MASS_MIN + (b + 1) * nut_sketch_bin_width()
+                     << "," << sketch_all.bins[b] << "\n";
+            }
+        }
+    }
+
+    // Записи своих белок: средняя соседки внутри процесса берётся напрямую, на краях блока - из обмена
+    std::vector<SquirrelRecord> records(my_squirrels);
+    for (int i = 0; i < my_squirrels; ++i) {
+        records[i].id    = my_first + i;
+        records[i].nuts  = my_counts[i];
+        records[i].avg   = my_avgs[i];
+        records[i].left  = (i > 0) ? my_avgs[i - 1] : ghost_left;
+        records[i].right = (i + 1 < my_squirrels) ? my_avgs[i + 1] : ghost_right;
+    }
+
+    if (opt.output == "csv" || opt.output == "bin") {
+        // Каждый процесс пишет свои записи сам, в общий файл по номеру первой белки
+        std::string header, bytes;
+        MPI_Offset header_len = 0, record_len = 0;
+        if (opt.output == "csv") {
+            header_len = static_cast<MPI_Offset>(SQUIRREL_CSV_HEADER_LEN);
+            record_len = static_cast<MPI_Offset>(SQUIRREL_CSV_RECORD_LEN);
+            if (rank == 0) header = SQUIRREL_CSV_HEADER;
+            bytes.reserve(records.size() * SQUIRREL_CSV_RECORD_LEN);
+            for (const auto& r : records) bytes += format_squirrel_csv(r);
+        } else {
+            record_len = static_cast<MPI_Offset>(sizeof(SquirrelRecord));
+            bytes.assign(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(SquirrelRecord));
+        }
+        write_records_at(comm, opt.out_file, header, bytes, record_len,
+                         header_len + record_len * my_first, header_len + record_len * NUM_SQUIRRELS);
+    } else if (opt.output == "summary") {
+        // На root собираются только итоги: общее число орехов, общий средний вес
+        // и белки с наименьшим и наибольшим средним
+        double local_mass = 0.0;
+        for (double v : my_sums) local_mass += v;
+        struct { double value; int id; } local_min = { my_avgs[0], my_first }, local_max = local_min, gmin, gmax;
+        for (int i = 1; i < my_squirrels; ++i) {
+            if (my_avgs[i] < local_min.value) local_min = { my_avgs[i], my_first + i };
+            if (my_avgs[i] > local_max.value) local_max = { my_avgs[i], my_first + i };
+        }
+        long long total = 0;
+        double total_mass = 0.0;
+        MPI_Reduce(&local_count, &total, 1, MPI_LONG_LONG, MPI_SUM, 0, comm);
+        MPI_Reduce(&local_mass, &total_mass, 1, MPI_DOUBLE, MPI_SUM, 0, comm);
+        MPI_Reduce(&local_min, &gmin, 1, MPI_DOUBLE_INT, MPI_MINLOC, 0, comm);
+        MPI_Reduce(&local_max, &gmax, 1, MPI_DOUBLE_INT, MPI_MAXLOC, 0, comm);
+        // потоковый режим: наибольшее число порций и всего отправленных обновлений
+        long long stream_local[2] = { stream_stats.epochs, stream_stats.sent }, stream_totals[2] = { 0, 0 };
+        if (opt.stream > 0) {
+            MPI_Reduce(&stream_local[0], &stream_totals[0], 1, MPI_LONG_LONG, MPI_MAX, 0, comm);
+            MPI_Reduce(&stream_local[1], &stream_totals[1], 1, MPI_LONG_LONG, MPI_SUM, 0, comm);
+        }
+        if (rank == 0) {
+            std::cout << std::fixed << std::setprecision(4)
+                      << "Белок: " << NUM_SQUIRRELS
+                      << ", орехов = " << total
+                      << ", общий ср. вес = " << (total > 0 ? total_mass / static_cast<double>(total) : 0.0)
+                      << ", мин. ср. вес = " << gmin.value << " (белка " << gmin.id << ")"
+                      << ", макс. ср. вес = " << gmax.value << " (белка " << gmax.id << ")"
+                      << ", перекос разбиения = " << squirrel_skew;
+            if (opt.rounds > 0) {
+                std::cout << ", раундов обмена = " << trade.rounds << std::scientific << std::setprecision(2)
+                          << ", изменение за раунд = " << trade.residual;
+            }
+            if (opt.stream > 0) {
+                std::cout << ", порций = " << stream_totals[0] << ", обновлений соседям = " << stream_totals[1];
+            }
+            if (sketching) {
+                std::cout << std::fixed << std::setprecision(4) << ", медиана = " << nut_sketch_quantile(sketch_all, 0.5)
+                          << ", p99 = " << nut_sketch_quantile(sketch_all, 0.99);
+            }
+            std::cout << std::endl;
+        }
+    } else if (opt.output == "text") {
+        // Строки своих белок процесс форматирует сам, а печатает их root по порядку:
+        // при нескольких белках на процесс mpirun может разрезать вывод процессов посреди строки
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(4);
+        for (int i = 0; i < my_squirrels; ++i) {
+            const auto& r = records[i];
+            out << "Белка " << r.id
+                << ": орехов = " << r.nuts
+                << ", мой ср. вес = " << r.avg
+                << ", слева = " << r.left
+                << ", справа = " << r.right;
+            if (sketching) {
+                // медиана белки вместе с соседками - по слитым гистограммам трёх белок
+                NutSketch near = my_sketches[i];
+                nut_sketch_merge(i > 0 ? my_sketches[i - 1] : sketch_left, near);
+                nut_sketch_merge(i + 1 < my_squirrels ? my_sketches[i + 1] : sketch_right, near);
+                out << ", медиана = " << nut_sketch_quantile(my_sketches[i], 0.5)
+                    << ", p99 = " << nut_sketch_quantile(my_sketches[i], 0.99)
+                    << ", медиана с соседками = " << nut_sketch_quantile(near, 0.5);
+            }
+            out << "\n";
+        }
+        print_in_rank_order(out.str(), 0, comm);
+        if (sketching && rank == 0) {
+            std::cout << std::fixed << std::setprecision(4) << "Все орехи: медиана = " << nut_sketch_quantile(sketch_all, 0.5)
+                      << ", p99 = " << nut_sketch_quantile(sketch_all, 0.99) << std::endl;
+        }
+    }
+    timer.mark(PHASE_OUTPUT);
+
+    if (opt.profile) {
+        report_profile(comm, timer, local_count, opt, TOTAL_NUTS, bytes_scattered, squirrel_skew, trade,
+                       stream_stats);
+    }
+
+    result.first = my_first;
+    result.records = std::move(records);
+    result.total_nuts = TOTAL_NUTS;
+    result.squirrel_skew = squirrel_skew;
+    result.bytes_scattered = bytes_scattered;
+    result.elapsed = std::accumulate(timer.times, timer.times + PHASE_COUNT, 0.0);
+    result.trade = std::move(trade);
+    result.stream = std::move(stream_stats);
+    if (sketching) result.sketch = sketch_all;
+    return result;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+// Симуляция белок как библиотека: run_squirrels(comm, opt) выполняет всё, что делает программа
+// squirrels, на любом коммуникаторе - MPI_COMM_WORLD (main.cpp) или его части после MPI_Comm_split
+// (tests_mpi.cpp гоняет так много конфигураций за один запуск mpirun). MPI_Init и MPI_Finalize -
+// забота вызывающего. Все процессы comm вызывают run_squirrels с одинаковыми параметрами.
+
+#include <mpi.h>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "latency_hist.hpp"
+#include "nut_sketch.hpp"
+#include "squirrel_record.hpp"
+
+// Параметры запуска из командной строки
+struct Options {
+    std::string gen  = "mt19937"; // генератор масс: mt19937 (как раньше) или philox (счётчиковый)
+    std::string dist = "scatter"; // scatter - root генерирует и рассылает, local - каждая белка генерирует свой кусок сама,
+                                  // shm - мешок в общей памяти узла (MPI_Win_allocate_shared), процессы читают его на месте
+    std::uint64_t seed = 42;      // зерно генератора
+    int num_squirrels = 100;      // количество белок (несколько белок может жить в одном процессе)
+    long long total_nuts = 1000298; // количество орехов в мешке
+    std::string exchange = "allgather"; // обмен средними: allgather, cart (соседский коллектив) или sendrecv
+    long long scatter_chunk = 0;  // >0 - рассылать мешок кусками по столько орехов и суммировать на лету
+    std::string sum = "naive";    // ядро суммирования: naive (как раньше), simd, kahan или pairwise (см. nut_sum.hpp)
+    std::string input;            // файл мешка (nut_bag.hpp); если задан, массы читаются из него, а не генерируются
+    std::string io = "mpiio";     // как читать файл мешка: mpiio (коллективное чтение) или mmap (один узел)
+    std::string output = "text";  // вывод: text (строки на русском), csv или bin (файл записей), summary (только итоги),
+                                  // none - ничего не выводить (результат забирает вызывающий run_squirrels)
+    std::string out_file;         // файл для --output csv/bin (по умолчанию squirrels.csv / squirrels.bin)
+    bool profile = false;         // замерять время фаз и печатать отчёт в JSON
+    std::string profile_out;      // файл для отчёта --profile (по умолчанию - стандартный вывод)
+    std::string partition = "random"; // разбиение мешка: random, even, bounded-random или weighted (nut_partition.hpp)
+    double partition_cap = 2.0;   // для bounded-random: кусок белки не больше cap * среднего
+    std::string weights;          // для weighted: файл с весами процессов (иначе замеряются при запуске)
+    std::string partition_mode = "root"; // root - разбивает root и рассылает, distributed - каждый процесс сам (MPI_Exscan)
+    long long rounds = 0;         // >0 - раунды обмена массой с соседками (диффузия средних) после подсчёта
+    double tolerance = 0.0;       // >0 - остановиться раньше, когда средние за раунд меняются меньше
+    int check_every = 10;         // как часто (в раундах) проверять сходимость через MPI_Iallreduce
+    double trade_rate = 0.25;     // доля разницы со соседкой, которая переходит за раунд (не больше 0.5)
+    long long stream = 0;         // >0 - потоковый режим: орехи приходят порциями по столько на белку
+    double stream_threshold = 1e-3; // в потоковом режиме соседкам сообщается только изменение средней больше порога
+    std::string wire = "f64";     // формат масс при рассылке: f64, f32, q24 или q16 (nut_wire.hpp)
+    long long max_message = std::numeric_limits<int>::max(); // наибольшее сообщение рассылки (элементов); меньше INT_MAX - всегда
+                                  // двухточечные куски вместо MPI_Scatterv(_c), чтобы проверить этот путь
+    int node_size = 0;            // для --dist shm: 0 - узлы по MPI_COMM_TYPE_SHARED, k > 0 - «узлы» по k процессов подряд
+    std::string sketch = "none";  // hist - гистограмма масс каждой белки (nut_sketch.hpp): медиана и p99
+    std::string sketch_out;       // файл для общей гистограммы всех орехов (CSV: lo,hi,count)
+};
+
+// Итоги раундов обмена (--rounds)
+struct TradeStats {
+    long long rounds = 0;           // сколько раундов сделано
+    bool converged = false;         // остановились по --tolerance
+    double residual = 0.0;          // наибольшее изменение средней за последний раунд (по всем белкам)
+    LatencyHist round_times;         // время раундов на этом процессе (сводка фиксированного размера)
+};
+
+// Итоги потокового режима (--stream)
+struct StreamStats {
+    long long epochs = 0;            // сколько порций пришло (у самой нагруженной белки процесса)
+    long long sent = 0;              // сколько обновлений отправлено соседним процессам
+    long long skipped = 0;           // сколько изменений крайних белок не дотянули до порога
+    LatencyHist latencies;           // от прихода порции у соседа до обновления его средней здесь (сводка)
+};
+
+// Результат run_squirrels на одном процессе
+struct SquirrelsResult {
+    int status = 0;                      // 0 - успех, иначе код завершения программы (ошибку root напечатал в stderr)
+    int first = 0;                       // номер первой белки процесса
+    std::vector<SquirrelRecord> records; // записи белок процесса: орехи, средняя, средние соседок
+    long long total_nuts = 0;            // орехов в мешке (с --input - из заголовка файла)
+    double squirrel_skew = 1.0;          // перекос разбиения (на root, при --profile или --output summary)
+    long long bytes_scattered = 0;       // сколько байт масс разослал root
+    double elapsed = 0.0;                // время всех фаз на этом процессе
+    TradeStats trade;
+    StreamStats stream;
+    NutSketch sketch;                    // --sketch hist: гистограмма всех орехов (на root)
+};
+
+// Разбираем аргументы; при ошибке возвращаем false и текст ошибки в err
+bool parse_options(int argc, char** argv, Options& opt, std::string& err);
+
+// Проверяем сочетание параметров (и подставляем файл вывода по умолчанию); при ошибке - false и текст в err
+bool validate_options(Options& opt, std::string& err);
+
+// Запуск симуляции на comm; opt уже проверены validate_options (parse_options проверяет сам)
+SquirrelsResult run_squirrels(MPI_Comm comm, const Options& opt);
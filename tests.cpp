@@ -4,8 +4,20 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <cstdint>
+#include <cstdio>
 #include <cstdlib>
 #include <cmath>
+#include <numeric>
+#include <algorithm>
+
+#include "latency_hist.hpp"
+#include "nut_partition.hpp"
+#include "nut_rng.hpp"
+#include "nut_sketch.hpp"
+#include "nut_sum.hpp"
+#include "nut_wire.hpp"
+#include "squirrel_record.hpp"
 
 static const int NUM_SQUIRRELS = 100; // кол-во белок
 static const long long TOTAL_NUTS = 1000298; // кол-во орехов
@@ -17,6 +29,30 @@ static const char* BASE_CMD = "mpirun --oversubscribe -np ";  // далее до
 // Имена файлов, в которые мы будем перенаправлять вывод тестируемой программы
 static const char* OUTPUT_FILE_CORRECT = "squirrels_output_correct.txt"; // вывод при правильном числе процессов.
 static const char* OUTPUT_FILE_WRONG   = "squirrels_output_wrong.txt"; // при неправильном
+static const char* OUTPUT_FILE_PHILOX_SCATTER = "squirrels_output_philox_scatter.txt"; // philox, root рассылает массы
+static const char* OUTPUT_FILE_PHILOX_LOCAL   = "squirrels_output_philox_local.txt";   // philox, каждая белка генерирует сама
+static const char* OUTPUT_FILE_CART     = "squirrels_output_cart.txt";     // обмен через MPI_Neighbor_alltoall
+static const char* OUTPUT_FILE_SENDRECV = "squirrels_output_sendrecv.txt"; // обмен через MPI_Sendrecv
+static const char* OUTPUT_FILE_RATIO    = "squirrels_output_ratio.txt";    // несколько белок на процесс
+static const char* OUTPUT_FILE_CHUNKED  = "squirrels_output_chunked.txt";  // конвейерная рассылка кусками
+static const char* BAG_FILE            = "squirrels_test.bag";            // мешок для чтения из файла (make_bag)
+static const char* OUTPUT_FILE_BAG_GEN = "squirrels_output_bag_gen.txt";  // эталон: philox на месте
+static const char* OUTPUT_FILE_BAG     = "squirrels_output_bag.txt";      // мешок из файла
+static const char* RECORDS_FILE_CSV    = "squirrels_records.csv";         // структурированный вывод в CSV
+static const char* RECORDS_FILE_BIN    = "squirrels_records.bin";         // структурированный вывод в двоичном виде
+static const char* OUTPUT_FILE_SUMMARY = "squirrels_output_summary.txt";  // только итоги
+static const char* PROFILE_FILE        = "squirrels_profile.json";        // отчёт --profile
+static const char* OUTPUT_FILE_PARTITION = "squirrels_output_partition.txt"; // другие стратегии разбиения
+static const char* OUTPUT_FILE_DISTRIBUTED = "squirrels_output_distributed.txt"; // разбиение без root
+static const char* OUTPUT_FILE_TRADE   = "squirrels_output_trade.txt";    // раунды обмена массой
+static const char* OUTPUT_FILE_STREAM  = "squirrels_output_stream.txt";   // потоковый режим
+static const char* OUTPUT_FILE_WIRE    = "squirrels_output_wire.txt";     // сжатая рассылка
+static const char* OUTPUT_FILE_SHM     = "squirrels_output_shm.txt";      // мешок в общей памяти узла
+static const char* OUTPUT_FILE_SKETCH  = "squirrels_output_sketch.txt";   // гистограммы масс
+static const char* SKETCH_FILE         = "squirrels_sketch.csv";          // общая гистограмма --sketch-out
+static const char* OUTPUT_FILE_P2P     = "squirrels_output_p2p.txt";      // рассылка двухточечными кусками
+static const char* OUTPUT_FILE_COUNTED = "squirrels_output_counted.txt"; // таблица счётчиков PMPI
+static const char* WEIGHTS_FILE        = "squirrels_weights.txt";         // веса процессов для --partition weighted
 
 // Описывает данные, кот-ые мы парсим из вывода для одной белки
 struct SquirrelInfo {
@@ -153,13 +189,115 @@ bool parse_line(const std::string& line, SquirrelInfo& out) {
 // Запуск программы с заданным числом процессов и выводом в файл
 // Возвращает код из std::system
 // std::ostringstream cmd; - строковый поток для сборки командной строки
-int run_program_with_np(int np, const std::string& out_file) {
+// args - дополнительные параметры командной строки программы
+// program - другой бинарник той же программы, например squirrels_counted со слоем PMPI
+int run_program_with_np(int np, const std::string& out_file, const std::string& args = "",
+                        const std::string& program = "./squirrels") {
     std::ostringstream cmd;
-    cmd << BASE_CMD << np << " ./squirrels > " << out_file << " 2>&1"; // запуск тестируемой программы, np - число процессоров
+    cmd << BASE_CMD << np << " " << program << " " << args << " > " << out_file << " 2>&1"; // запуск тестируемой программы, np - число процессоров
     // пример вида верхней команды: mpirun -np 100 ./squirrels > squirrels_output_correct.txt 2>&1
     return std::system(cmd.str().c_str()); // передаём команду оболочке, запускаем её. Возвращает код возврата процесса
 }
 
+// Читаем файл вывода и парсим строки всех белок в map id: info
+std::map<int, SquirrelInfo> parse_output_file(const std::string& out_file) {
+    std::ifstream fin(out_file);
+    if (!fin.is_open()) {
+        throw std::runtime_error("Не удалось открыть файл вывода: " + out_file);
+    }
+    std::map<int, SquirrelInfo> result;
+    std::string line;
+    while (std::getline(fin, line)) {
+        SquirrelInfo info;
+        if (parse_line(line, info)) {
+            result[info.id] = info;
+        }
+    }
+    return result;
+}
+
+// Весь файл одной строкой (для побайтового сравнения выводов)
+std::string read_whole_file(const std::string& path) {
+    std::ifstream fin(path, std::ios::binary);
+    if (!fin.is_open()) {
+        throw std::runtime_error("Не удалось открыть файл: " + path);
+    }
+    return std::string((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+}
+
+// Переводим запись структурированного вывода в SquirrelInfo
+SquirrelInfo to_info(const SquirrelRecord& r) {
+    SquirrelInfo info;
+    info.id = static_cast<int>(r.id);
+    info.nuts = r.nuts;
+    info.avg = r.avg;
+    info.left = r.left;
+    info.right = r.right;
+    return info;
+}
+
+// Загружаем вывод --output csv: записи фиксированной длины после строки заголовка
+std::map<int, SquirrelInfo> load_csv_output(const std::string& path) {
+    std::ifstream fin(path);
+    if (!fin.is_open()) {
+        throw std::runtime_error("Не удалось открыть файл вывода: " + path);
+    }
+    std::map<int, SquirrelInfo> result;
+    std::string line;
+    std::getline(fin, line); // заголовок
+    while (std::getline(fin, line)) {
+        SquirrelRecord r;
+        if (!parse_squirrel_csv(line, r)) {
+            throw std::runtime_error("Некорректная строка CSV: " + line);
+        }
+        result[static_cast<int>(r.id)] = to_info(r);
+    }
+    return result;
+}
+
+// Загружаем вывод --output bin: массив SquirrelRecord
+std::map<int, SquirrelInfo> load_bin_output(const std::string& path) {
+    std::ifstream fin(path, std::ios::binary);
+    if (!fin.is_open()) {
+        throw std::runtime_error("Не удалось открыть файл вывода: " + path);
+    }
+    std::map<int, SquirrelInfo> result;
+    SquirrelRecord r;
+    while (fin.read(reinterpret_cast<char*>(&r), sizeof(r))) {
+        result[static_cast<int>(r.id)] = to_info(r);
+    }
+    return result;
+}
+
+// Проверяем, что два вывода совпадают белка в белку (по умолчанию - в пределах печатаемой точности)
+void assert_same_output(const std::map<int, SquirrelInfo>& a, const std::map<int, SquirrelInfo>& b,
+                        double EPS = 1e-9) {
+    ASSERT_EQ(a.size(), b.size());
+    for (const auto& kv : a) {
+        const auto& x = kv.second;
+        const auto& y = b.at(kv.first);
+        ASSERT_EQ(x.nuts, y.nuts);
+        ASSERT_NEAR(x.avg,   y.avg,   EPS);
+        ASSERT_NEAR(x.left,  y.left,  EPS);
+        ASSERT_NEAR(x.right, y.right, EPS);
+    }
+}
+
+// Проверяем вывод для num белок и total орехов: все id на месте, орехов в сумме total,
+// соседки слева и справа по кругу согласованы со средними
+void assert_consistent_ring(const std::map<int, SquirrelInfo>& byId, int num, long long total) {
+    const double EPS = 1e-9;
+    ASSERT_EQ(static_cast<int>(byId.size()), num);
+    long long sum_nuts = 0;
+    for (int i = 0; i < num; ++i) {
+        const auto& s = byId.at(i);
+        sum_nuts += s.nuts;
+        ASSERT_NEAR(s.left,  byId.at((i - 1 + num) % num).avg, EPS);
+        ASSERT_NEAR(s.right, byId.at((i + 1) % num).avg, EPS);
+    }
+    ASSERT_EQ(sum_nuts, total);
+}
+
 // Запускаем программу с правильным числом процессов и читаем её вывод
 // squirrels - вектор, куда мы будем складывать распарсенную информацию по всем белкам
 // exit_code - сюда положим код возврата запуска
@@ -201,9 +339,9 @@ int main() {
         ASSERT_EQ(exit_code_correct, 0);
     });
 
-    // Тест 2: Запуск с неправильным числом процессов
+    // Тест 2: Запуск с неправильным числом процессов: процессов больше, чем белок
     runner.run("Запуск с неправильным числом процессов", [&]() {
-        int exit_code_wrong = run_program_with_np(4, OUTPUT_FILE_WRONG);
+        int exit_code_wrong = run_program_with_np(4, OUTPUT_FILE_WRONG, "--squirrels 2");
         ASSERT_TRUE(exit_code_wrong != 0); // при неправильном заупске, код возврата не должен быть равен 0
 
         // И ожидаем в выводе сообщение об ошибке
@@ -212,10 +350,10 @@ int main() {
         // Читаем содержимое файла целиком в строку contents
         // конструктор строки от istreambuf_iterator<char> - стандартный способ прочитать весь файл.
         std::string contents((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
-        // Ищем подстроку "Ошибка: программу нужно запускать с" 
+        // Ищем подстроку "Ошибка: процессов" 
         // Если такая строка не находится, тометод возвращает не индекс вхождения подстроки, а специальное значение std::string::npos
         // То есть если у нас ему не равно, т.е оно не возвращено, то сообщение об ошибке найдено и все супер
-        ASSERT_TRUE(contents.find("Ошибка: программу нужно запускать с") != std::string::npos);
+        ASSERT_TRUE(contents.find("Ошибка: процессов") != std::string::npos);
     });
 
     // Для удобных проверок построим map id: info
@@ -321,6 +459,498 @@ int main() {
         ASSERT_NEAR(s99.right, s0.avg,  EPS);
     });
 
+    // Тест 12: счётчиковый генератор даёт одинаковый результат,
+    // генерирует ли мешок root (с рассылкой) или каждая белка свой кусок
+    runner.run("Philox: генерация на месте совпадает с рассылкой от root", [&]() {
+        ASSERT_EQ(run_program_with_np(NUM_SQUIRRELS, OUTPUT_FILE_PHILOX_SCATTER, "--gen philox --dist scatter"), 0);
+        ASSERT_EQ(run_program_with_np(NUM_SQUIRRELS, OUTPUT_FILE_PHILOX_LOCAL,   "--gen philox --dist local"), 0);
+        auto scattered = parse_output_file(OUTPUT_FILE_PHILOX_SCATTER);
+        auto local     = parse_output_file(OUTPUT_FILE_PHILOX_LOCAL);
+        ASSERT_EQ(static_cast<int>(local.size()), NUM_SQUIRRELS);
+        assert_same_output(scattered, local);
+    });
+
+    // Тест 13: обмен по кольцу через декартову топологию даёт те же соседние средние, что и MPI_Allgather
+    runner.run("Обмен через MPI_Neighbor_alltoall совпадает с MPI_Allgather", [&]() {
+        ASSERT_EQ(run_program_with_np(NUM_SQUIRRELS, OUTPUT_FILE_CART, "--exchange cart"), 0);
+        assert_same_output(byId, parse_output_file(OUTPUT_FILE_CART));
+    });
+
+    // Тест 14: то же для обмена через MPI_Sendrecv
+    runner.run("Обмен через MPI_Sendrecv совпадает с MPI_Allgather", [&]() {
+        ASSERT_EQ(run_program_with_np(NUM_SQUIRRELS, OUTPUT_FILE_SENDRECV, "--exchange sendrecv"), 0);
+        assert_same_output(byId, parse_output_file(OUTPUT_FILE_SENDRECV));
+    });
+
+    // Тест 15: при любом соотношении процессов и белок результат тот же, что и при белке на процесс
+    runner.run("Несколько белок на процесс: результат не зависит от числа процессов", [&]() {
+        const int nps[] = { 1, 3, 7 };
+        for (int np : nps) {
+            ASSERT_EQ(run_program_with_np(np, OUTPUT_FILE_RATIO, "--exchange sendrecv"), 0);
+            assert_same_output(byId, parse_output_file(OUTPUT_FILE_RATIO));
+        }
+    });
+
+    // Тест 16: белок намного больше, чем процессов, и число орехов задано параметром
+    runner.run("1000 белок на 4 процессах", [&]() {
+        ASSERT_EQ(run_program_with_np(4, OUTPUT_FILE_RATIO, "--squirrels 1000 --nuts 2000000 --exchange cart"), 0);
+        assert_consistent_ring(parse_output_file(OUTPUT_FILE_RATIO), 1000, 2000000);
+    });
+
+    // Тест 17: конвейерная рассылка кусками (в том числе кусками меньше куска одной белки)
+    // даёт тот же результат, что и одна рассылка всего мешка. Сравниваем записи CSV с полной
+    // точностью: сумма белки складывается из сумм по раундам, поэтому средние могут отличаться
+    // в последних битах (на этом мешке до ~6e-14) - допуск 1e-12
+    runner.run("Конвейерная рассылка кусками совпадает с MPI_Scatterv", [&]() {
+        const std::string csv = std::string(" --output csv --out-file ") + RECORDS_FILE_CSV;
+        ASSERT_EQ(run_program_with_np(4, OUTPUT_FILE_CHUNKED, csv), 0);
+        auto expected = load_csv_output(RECORDS_FILE_CSV);
+        assert_consistent_ring(expected, NUM_SQUIRRELS, TOTAL_NUTS);
+        const char* chunks[] = { "--scatter-chunk 777", "--scatter-chunk 100000000" };
+        for (const char* args : chunks) {
+            ASSERT_EQ(run_program_with_np(4, OUTPUT_FILE_CHUNKED, args + csv), 0);
+            assert_same_output(expected, load_csv_output(RECORDS_FILE_CSV), 1e-12);
+        }
+    });
+
+    // Тест 18: все ядра суммирования правильно обрабатывают хвосты любой длины
+    runner.run("Ядра суммирования: короткие куски любой длины", [&]() {
+        std::vector<double> x(300);
+        philox_fill_nuts(7, 0, x.data(), x.size(), 0.1, 10.0);
+        const char* kernels[] = { "naive", "simd", "kahan", "pairwise" };
+        for (const char* name : kernels) {
+            nut_sum_fn fn = nut_sum_kernel(name);
+            ASSERT_TRUE(fn != nullptr);
+            for (std::size_t n = 0; n <= x.size(); ++n) {
+                double ref = static_cast<double>(nut_sum_reference(x.data(), n));
+                ASSERT_NEAR(fn(x.data(), n), ref, 1e-12 * (1.0 + ref));
+            }
+        }
+    });
+
+    // Тест 19: на большой белке компенсированное и попарное суммирование дают среднее
+    // с ошибкой на порядки меньше прежнего допуска 1e-9
+    runner.run("Ядра суммирования: точность среднего на 10^7 орехов", [&]() {
+        const std::size_t n = 10000000;
+        std::vector<double> x(n);
+        philox_fill_nuts(42, 0, x.data(), n, 0.1, 10.0);
+        double ref_avg = static_cast<double>(nut_sum_reference(x.data(), n) / n);
+        ASSERT_NEAR(nut_sum_kahan(x.data(), n) / n,    ref_avg, 1e-14);
+        ASSERT_NEAR(nut_sum_pairwise(x.data(), n) / n, ref_avg, 1e-14);
+        ASSERT_NEAR(nut_sum_simd(x.data(), n) / n,     ref_avg, 1e-12);
+    });
+
+    // Тест 20: мешок из файла (коллективное MPI-IO и mmap) даёт тот же результат,
+    // что и генерация тех же масс на месте
+    runner.run("Мешок из файла: MPI-IO и mmap совпадают с генерацией на месте", [&]() {
+        std::string make_cmd = std::string("./make_bag ") + BAG_FILE + " --rng philox > /dev/null";
+        ASSERT_EQ(std::system(make_cmd.c_str()), 0);
+        ASSERT_EQ(run_program_with_np(4, OUTPUT_FILE_BAG_GEN, "--gen philox --dist local"), 0);
+        auto expected = parse_output_file(OUTPUT_FILE_BAG_GEN);
+        ASSERT_EQ(static_cast<int>(expected.size()), NUM_SQUIRRELS);
+        const char* modes[] = { "mpiio", "mmap" };
+        for (const char* io : modes) {
+            ASSERT_EQ(run_program_with_np(4, OUTPUT_FILE_BAG, std::string("--input ") + BAG_FILE + " --io " + io), 0);
+            assert_same_output(expected, parse_output_file(OUTPUT_FILE_BAG));
+        }
+        // заголовок с огромным числом орехов (count * 8 переполняет uint64) - ошибка, а не чтение мимо файла
+        {
+            std::fstream bag(BAG_FILE, std::ios::in | std::ios::out | std::ios::binary);
+            std::uint64_t count = (1ULL << 61) + 1;
+            bag.seekp(16);
+            bag.write(reinterpret_cast<const char*>(&count), sizeof(count));
+        }
+        ASSERT_TRUE(run_program_with_np(4, OUTPUT_FILE_BAG, std::string("--input ") + BAG_FILE) != 0);
+        // мешок нужен следующим тестам целым
+        ASSERT_EQ(std::system(make_cmd.c_str()), 0);
+    });
+
+    // Тест 21: структурированный вывод в CSV и в двоичном виде: те же белки, что и в тексте,
+    // но с полной точностью, поэтому соседки согласованы точно
+    runner.run("Вывод в CSV и двоичный файл через MPI-IO", [&]() {
+        ASSERT_EQ(run_program_with_np(4, OUTPUT_FILE_BAG, std::string("--output csv --out-file ") + RECORDS_FILE_CSV), 0);
+        ASSERT_EQ(run_program_with_np(4, OUTPUT_FILE_BAG, std::string("--output bin --out-file ") + RECORDS_FILE_BIN), 0);
+        auto csv = load_csv_output(RECORDS_FILE_CSV);
+        auto bin = load_bin_output(RECORDS_FILE_BIN);
+        assert_consistent_ring(csv, NUM_SQUIRRELS, TOTAL_NUTS);
+        assert_same_output(csv, bin, 0.0);
+        // текстовый вывод округлён до 4 знаков
+        assert_same_output(csv, byId, 5e-5);
+        for (const auto& kv : csv) {
+            ASSERT_EQ(kv.second.left, csv.at((kv.first - 1 + NUM_SQUIRRELS) % NUM_SQUIRRELS).avg);
+        }
+    });
+
+    // Тест 22: режим только итогов печатает одну строку с общим числом орехов
+    runner.run("Вывод только итогов", [&]() {
+        ASSERT_EQ(run_program_with_np(4, OUTPUT_FILE_SUMMARY, "--output summary"), 0);
+        std::ifstream fin(OUTPUT_FILE_SUMMARY);
+        std::string contents((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+        ASSERT_TRUE(contents.find("Белок: 100, орехов = 1000298") != std::string::npos);
+        ASSERT_TRUE(parse_output_file(OUTPUT_FILE_SUMMARY).empty());
+    });
+
+    // Тест 23: отчёт --profile содержит все фазы и коэффициенты дисбаланса
+    runner.run("Отчёт о времени фаз в JSON", [&]() {
+        ASSERT_EQ(run_program_with_np(4, OUTPUT_FILE_SUMMARY,
+                                      std::string("--output summary --profile-out ") + PROFILE_FILE), 0);
+        std::ifstream fin(PROFILE_FILE);
+        ASSERT_TRUE(fin.is_open());
+        std::string json((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+        const char* keys[] = { "\"ranks\": 4", "\"generate\"", "\"partition\"", "\"scatter\"", "\"compute\"",
+                               "\"exchange\"", "\"output\"", "\"imbalance\"", "\"communication\"" };
+        for (const char* key : keys) {
+            ASSERT_TRUE(json.find(key) != std::string::npos);
+        }
+        // строки конфигурации экранируются: кавычка в имени мешка не ломает JSON
+        const std::string quoted_bag = "squirrels_\"test\".bag";
+        {
+            std::ifstream src(BAG_FILE, std::ios::binary);
+            std::ofstream dst(quoted_bag, std::ios::binary);
+            dst << src.rdbuf();
+        }
+        ASSERT_EQ(run_program_with_np(4, OUTPUT_FILE_SUMMARY, "--output summary --input '" + quoted_bag +
+                                      "' --profile-out " + PROFILE_FILE), 0);
+        std::remove(quoted_bag.c_str());
+        ASSERT_TRUE(read_whole_file(PROFILE_FILE).find("\"input\": \"squirrels_\\\"test\\\".bag\"") != std::string::npos);
+    });
+
+    // Тест 24: стратегии разбиения дают ровно total орехов, минимум по ореху на белку
+    // и перекос не больше обещанного
+    runner.run("Стратегии разбиения: суммы, минимум и перекос", [&]() {
+        const long long totals[] = { 1000298, 1000, 100, 57 };
+        for (long long total : totals) {
+            std::mt19937 gen(42);
+            std::vector<long long> random, even, bounded, weighted;
+            partition_random(total, 100, gen, random);
+            partition_even(total, 100, even);
+            partition_bounded_random(total, 100, 1.5, gen, bounded);
+            std::vector<double> weights(100);
+            for (int i = 0; i < 100; ++i) weights[i] = 1.0 + i % 4; // процессы в 1..4 раза быстрее
+            partition_weighted(total, weights, weighted);
+            for (const auto* counts : { &random, &even, &bounded, &weighted }) {
+                ASSERT_EQ(std::accumulate(counts->begin(), counts->end(), 0LL), total);
+                for (long long c : *counts) ASSERT_TRUE(c >= (total >= 100 ? 1 : 0));
+            }
+            long long min_even = *std::min_element(even.begin(), even.end());
+            long long max_even = *std::max_element(even.begin(), even.end());
+            ASSERT_TRUE(max_even - min_even <= 1);
+            for (long long c : bounded) ASSERT_TRUE(c <= static_cast<long long>(std::ceil(1.5 * total / 100.0)));
+            if (total == 1000298) {
+                ASSERT_TRUE(partition_max_mean(random) > 2.0);
+                ASSERT_TRUE(partition_max_mean(bounded) <= 1.5 + 1e-4);
+                // белка с весом 4 получает вчетверо больше белки с весом 1
+                ASSERT_NEAR(static_cast<double>(weighted[3]) / weighted[0], 4.0, 1e-3);
+            }
+        }
+    });
+
+    // Тест 25: программа с другими стратегиями разбиения: вывод согласован,
+    // а even и weighted с равными весами делят мешок поровну
+    runner.run("Запуск с --partition even, bounded-random и weighted", [&]() {
+        {
+            std::ofstream fout(WEIGHTS_FILE);
+            fout << "1 1 1 1\n";
+        }
+        const std::string modes[] = {
+            "--partition even", "--partition bounded-random --partition-cap 1.2",
+            std::string("--partition weighted --weights ") + WEIGHTS_FILE, "--partition weighted"
+        };
+        for (const auto& args : modes) {
+            ASSERT_EQ(run_program_with_np(4, OUTPUT_FILE_PARTITION, args), 0);
+            auto result = parse_output_file(OUTPUT_FILE_PARTITION);
+            assert_consistent_ring(result, NUM_SQUIRRELS, TOTAL_NUTS);
+            for (const auto& kv : result) {
+                if (args == "--partition weighted") continue; // веса замеряются, доли не известны заранее
+                long long limit = (args.find("bounded") != std::string::npos)
+                                ? static_cast<long long>(std::ceil(1.2 * TOTAL_NUTS / NUM_SQUIRRELS))
+                                : TOTAL_NUTS / NUM_SQUIRRELS + 1;
+                ASSERT_TRUE(kv.second.nuts <= limit);
+            }
+        }
+    });
+
+    // Тест 26: распределённое разбиение: куски, найденные по частям, совпадают с найденными целиком,
+    // в сумме дают total и у каждой белки хотя бы один орех
+    runner.run("Распределённое разбиение по частям совпадает с целым", [&]() {
+        const long long totals[] = { 1000298, 5000, 1000, 999 };
+        for (long long total : totals) {
+            for (const char* strategy : { "random", "even" }) {
+                std::vector<long long> whole(1000);
+                partition_distributed(strategy, 42, total, 1000, 0, 1000, whole.data());
+                ASSERT_EQ(std::accumulate(whole.begin(), whole.end(), 0LL), total);
+                for (long long c : whole) ASSERT_TRUE(c >= (total >= 1000 ? 1 : 0));
+                // те же белки кусками разной длины, как у процессов
+                const int firsts[] = { 0, 1, 63, 64, 65, 333, 500, 999, 1000 };
+                for (std::size_t k = 0; k + 1 < sizeof(firsts) / sizeof(firsts[0]); ++k) {
+                    int count = firsts[k + 1] - firsts[k];
+                    std::vector<long long> part(count);
+                    partition_distributed(strategy, 42, total, 1000, firsts[k], count, part.data());
+                    for (int i = 0; i < count; ++i) ASSERT_EQ(part[i], whole[firsts[k] + i]);
+                }
+            }
+        }
+        // разбиение зависит только от Philox, а не от <random> стандартной библиотеки:
+        // эти числа одинаковы для libstdc++, libc++ и MSVC
+        const long long expected[] = { 2630, 463, 2997, 317, 368, 1863, 1826, 300 };
+        std::vector<long long> head(8);
+        partition_distributed("random", 42, 1000298, 1000, 0, 8, head.data());
+        for (int i = 0; i < 8; ++i) ASSERT_EQ(head[i], expected[i]);
+    });
+
+    // Тест 27: запуск с --partition-mode distributed: результат не зависит от числа процессов,
+    // а из файла мешка получается то же, что при генерации на месте
+    runner.run("Разбиение без root (MPI_Exscan) не зависит от числа процессов", [&]() {
+        const std::string args = "--gen philox --dist local --partition-mode distributed";
+        ASSERT_EQ(run_program_with_np(1, OUTPUT_FILE_DISTRIBUTED, args), 0);
+        auto expected = parse_output_file(OUTPUT_FILE_DISTRIBUTED);
+        assert_consistent_ring(expected, NUM_SQUIRRELS, TOTAL_NUTS);
+        ASSERT_EQ(run_program_with_np(7, OUTPUT_FILE_DISTRIBUTED, args), 0);
+        assert_same_output(expected, parse_output_file(OUTPUT_FILE_DISTRIBUTED));
+        ASSERT_EQ(run_program_with_np(4, OUTPUT_FILE_DISTRIBUTED,
+                                      std::string("--partition-mode distributed --input ") + BAG_FILE), 0);
+        assert_same_output(expected, parse_output_file(OUTPUT_FILE_DISTRIBUTED));
+    });
+
+    // Тест 28: раунды обмена массой: результат не зависит от числа процессов,
+    // сумма средних сохраняется, а с --tolerance средние сходятся к общему среднему
+    runner.run("Раунды обмена с постоянными запросами и проверкой сходимости", [&]() {
+        ASSERT_EQ(run_program_with_np(1, OUTPUT_FILE_TRADE, "--output csv --out-file " + std::string(RECORDS_FILE_CSV)
+                                      + " --rounds 50"), 0);
+        auto one = load_csv_output(RECORDS_FILE_CSV);
+        ASSERT_EQ(run_program_with_np(4, OUTPUT_FILE_TRADE, "--output csv --out-file " + std::string(RECORDS_FILE_CSV)
+                                      + " --rounds 50"), 0);
+        auto four = load_csv_output(RECORDS_FILE_CSV);
+        assert_same_output(one, four, 1e-12);
+
+        double sum_before = 0.0, sum_after = 0.0;
+        for (const auto& kv : byId) sum_before += kv.second.avg;
+        for (const auto& kv : four) sum_after += kv.second.avg;
+        ASSERT_NEAR(sum_after, sum_before, 1e-2); // текстовые средние округлены до 4 знаков
+        for (const auto& kv : four) ASSERT_EQ(kv.second.nuts, byId.at(kv.first).nuts);
+
+        ASSERT_EQ(run_program_with_np(4, OUTPUT_FILE_TRADE, "--output csv --out-file " + std::string(RECORDS_FILE_CSV)
+                                      + " --rounds 1000000 --tolerance 1e-10 --check-every 7"), 0);
+        auto converged = load_csv_output(RECORDS_FILE_CSV);
+        double mean = sum_before / NUM_SQUIRRELS;
+        for (const auto& kv : converged) {
+            ASSERT_NEAR(kv.second.avg, mean, 1e-3);
+            ASSERT_NEAR(kv.second.left, converged.at((kv.first - 1 + NUM_SQUIRRELS) % NUM_SQUIRRELS).avg, 1e-12);
+        }
+    });
+
+    // Тест 29: потоковый режим (порции, статистика Уэлфорда, обновления соседей по порогу)
+    // приходит к тем же средним, что и подсчёт по всему куску, и соседки в конце точные
+    runner.run("Потоковый режим совпадает с подсчётом по всему мешку", [&]() {
+        ASSERT_EQ(run_program_with_np(4, OUTPUT_FILE_STREAM, "--gen philox --dist local --output csv --out-file "
+                                      + std::string(RECORDS_FILE_CSV)), 0);
+        auto expected = load_csv_output(RECORDS_FILE_CSV);
+        const char* modes[] = { "--stream 1000", "--stream 777 --stream-threshold 0", "--stream 100000000" };
+        for (const char* mode : modes) {
+            ASSERT_EQ(run_program_with_np(3, OUTPUT_FILE_STREAM, std::string("--gen philox --dist local --output csv --out-file ")
+                                          + RECORDS_FILE_CSV + " " + mode), 0);
+            auto streamed = load_csv_output(RECORDS_FILE_CSV);
+            assert_same_output(expected, streamed, 1e-12);
+            assert_consistent_ring(streamed, NUM_SQUIRRELS, TOTAL_NUTS);
+        }
+        // порции из файла мешка против подсчёта того же мешка целиком - по записям CSV с полной точностью:
+        // слияние Чана отличается от суммы всего куска только округлением (на этом мешке до ~4e-14)
+        const std::string bag_csv = std::string("--input ") + BAG_FILE + " --output csv --out-file " + RECORDS_FILE_CSV;
+        ASSERT_EQ(run_program_with_np(4, OUTPUT_FILE_STREAM, bag_csv), 0);
+        auto whole = load_csv_output(RECORDS_FILE_CSV);
+        ASSERT_EQ(run_program_with_np(4, OUTPUT_FILE_STREAM, bag_csv + " --stream 5000"), 0);
+        auto streamed = load_csv_output(RECORDS_FILE_CSV);
+        assert_same_output(whole, streamed, 1e-12);
+        assert_consistent_ring(streamed, NUM_SQUIRRELS, TOTAL_NUTS);
+    });
+
+    // Тест 30: сжатые форматы: размер и ошибка каждой массы в пределах документированной границы
+    runner.run("Сжатый формат масс: размер и граница ошибки", [&]() {
+        const std::size_t sizes[] = { 0, 1, 4095, 4096, 4097, 100000 };
+        for (std::size_t n : sizes) {
+            std::vector<double> x(n), y(n);
+            philox_fill_nuts(5, 0, x.data(), n, NUT_MASS_MIN, NUT_MASS_MAX);
+            for (const char* format : { "f64", "f32", "q24", "q16" }) {
+                std::vector<unsigned char> wire(nut_wire_bytes(format, n));
+                nut_wire_encode(format, x.data(), n, wire.data());
+                nut_wire_decode(format, wire.data(), n, y.data());
+                double bound = nut_wire_error_bound(format) * (1.0 + 1e-9);
+                for (std::size_t i = 0; i < n; ++i) ASSERT_TRUE(std::fabs(x[i] - y[i]) <= bound);
+            }
+            ASSERT_TRUE(nut_wire_bytes("q16", n) <= n * 2 + (n / 4096 + 1) * 16);
+        }
+        // одинаковые массы в куске (step = 0) раскодируются точно
+        std::vector<double> same(5000, 3.25), back(5000);
+        std::vector<unsigned char> wire(nut_wire_bytes("q16", same.size()));
+        nut_wire_encode("q16", same.data(), same.size(), wire.data());
+        nut_wire_decode("q16", wire.data(), same.size(), back.data());
+        ASSERT_TRUE(back == same);
+    });
+
+    // Тест 31: рассылка в сжатом формате: средние белок отличаются от рассылки double
+    // не больше чем на границу ошибки формата, числа орехов те же
+    runner.run("Сжатая рассылка f32/q24/q16 в пределах допуска", [&]() {
+        ASSERT_EQ(run_program_with_np(4, OUTPUT_FILE_WIRE, std::string("--output csv --out-file ") + RECORDS_FILE_CSV), 0);
+        auto exact = load_csv_output(RECORDS_FILE_CSV);
+        for (const char* format : { "f32", "q24", "q16" }) {
+            ASSERT_EQ(run_program_with_np(4, OUTPUT_FILE_WIRE, std::string("--output csv --out-file ") + RECORDS_FILE_CSV
+                                          + " --wire " + format), 0);
+            auto compressed = load_csv_output(RECORDS_FILE_CSV);
+            assert_consistent_ring(compressed, NUM_SQUIRRELS, TOTAL_NUTS);
+            assert_same_output(exact, compressed, nut_wire_error_bound(format) + 1e-12);
+        }
+    });
+
+    // Тест 32: мешок в общей памяти узла: результат тот же, что у обычной рассылки,
+    // и на одном узле, и при делении процессов на «узлы» по --node-size
+    runner.run("Мешок в окне общей памяти (--dist shm) совпадает с рассылкой", [&]() {
+        for (const char* gen : { "mt19937", "philox" }) {
+            const std::string base = std::string("--gen ") + gen + " --output csv --out-file " + RECORDS_FILE_CSV;
+            ASSERT_EQ(run_program_with_np(4, OUTPUT_FILE_SHM, base), 0);
+            auto expected = load_csv_output(RECORDS_FILE_CSV);
+            const char* modes[] = { "--dist shm", "--dist shm --node-size 2", "--dist shm --node-size 1" };
+            for (const char* mode : modes) {
+                ASSERT_EQ(run_program_with_np(4, OUTPUT_FILE_SHM, base + " " + mode), 0);
+                assert_same_output(expected, load_csv_output(RECORDS_FILE_CSV), 0.0);
+            }
+            ASSERT_EQ(run_program_with_np(7, OUTPUT_FILE_SHM, base + " --dist shm --node-size 3"), 0);
+            assert_same_output(expected, load_csv_output(RECORDS_FILE_CSV), 0.0);
+        }
+    });
+
+    // Тест 33: гистограмма: слияние частей даёт гистограмму целого,
+    // а квантили отличаются от точных не больше чем на ширину корзины
+    runner.run("Гистограмма масс: слияние и квантили", [&]() {
+        const std::size_t n = 100003;
+        std::vector<double> x(n);
+        philox_fill_nuts(9, 0, x.data(), n, NUT_MASS_MIN, NUT_MASS_MAX);
+        NutSketch whole, merged;
+        nut_sketch_add(whole, x.data(), n);
+        const std::size_t cuts[] = { 0, 1, 777, 50000, n };
+        for (std::size_t k = 0; k + 1 < sizeof(cuts) / sizeof(cuts[0]); ++k) {
+            NutSketch part;
+            nut_sketch_add(part, x.data() + cuts[k], cuts[k + 1] - cuts[k]);
+            nut_sketch_merge(part, merged);
+        }
+        ASSERT_EQ(merged.count, whole.count);
+        ASSERT_EQ(merged.min, whole.min);
+        ASSERT_EQ(merged.max, whole.max);
+        for (int b = 0; b < NUT_SKETCH_BINS; ++b) ASSERT_EQ(merged.bins[b], whole.bins[b]);
+
+        std::vector<double> sorted(x);
+        std::sort(sorted.begin(), sorted.end());
+        for (double q : { 0.0, 0.01, 0.25, 0.5, 0.9, 0.99, 1.0 }) {
+            double exact = sorted[static_cast<std::size_t>(q * (n - 1))];
+            ASSERT_NEAR(nut_sketch_quantile(whole, q), exact, nut_sketch_bin_width());
+        }
+        ASSERT_EQ(nut_sketch_quantile(whole, 0.0), whole.min);
+        ASSERT_EQ(nut_sketch_quantile(whole, 1.0), whole.max);
+        // один орех и пустая гистограмма
+        NutSketch one, empty;
+        nut_sketch_add(one, x.data(), 1);
+        ASSERT_EQ(nut_sketch_quantile(one, 0.5), x[0]);
+        ASSERT_EQ(nut_sketch_quantile(empty, 0.5), 0.0);
+    });
+
+    // Тест 34: гистограммы в программе: медианы не зависят от числа процессов,
+    // общая гистограмма содержит все орехи, а средние и вывод без --sketch не меняются
+    runner.run("Гистограммы белок (--sketch hist) с редукцией своей MPI_Op", [&]() {
+        const std::string args = std::string("--sketch hist --sketch-out ") + SKETCH_FILE;
+        ASSERT_EQ(run_program_with_np(1, OUTPUT_FILE_SKETCH, args), 0);
+        std::string one = read_whole_file(OUTPUT_FILE_SKETCH), one_hist = read_whole_file(SKETCH_FILE);
+        ASSERT_EQ(run_program_with_np(4, OUTPUT_FILE_SKETCH, args), 0);
+        ASSERT_TRUE(read_whole_file(OUTPUT_FILE_SKETCH) == one);
+        ASSERT_TRUE(read_whole_file(SKETCH_FILE) == one_hist);
+        assert_same_output(byId, parse_output_file(OUTPUT_FILE_SKETCH));
+        ASSERT_TRUE(one.find("медиана с соседками = ") != std::string::npos);
+        ASSERT_TRUE(one.find("Все орехи: медиана = ") != std::string::npos);
+
+        std::ifstream fin(SKETCH_FILE);
+        std::string line;
+        std::getline(fin, line); // заголовок
+        long long total = 0;
+        int bins = 0;
+        while (std::getline(fin, line)) {
+            total += std::stoll(line.substr(line.rfind(',') + 1));
+            ++bins;
+        }
+        ASSERT_EQ(bins, NUT_SKETCH_BINS);
+        ASSERT_EQ(total, TOTAL_NUTS);
+    });
+
+    // Тест 35: двухточечная рассылка кусками (запасной путь для мешков больше 2^31 орехов),
+    // включённая маленьким --max-message, раздаёт те же массы, что MPI_Scatterv(_c)
+    runner.run("Рассылка двухточечными кусками (--max-message) совпадает с коллективной", [&]() {
+        const std::string csv = std::string(" --output csv --out-file ") + RECORDS_FILE_CSV;
+        const char* modes[] = { "", "--scatter-chunk 5000", "--dist shm --node-size 2", "--wire q16" };
+        for (const char* mode : modes) {
+            ASSERT_EQ(run_program_with_np(4, OUTPUT_FILE_P2P, std::string(mode) + csv), 0);
+            std::string expected = read_whole_file(RECORDS_FILE_CSV);
+            ASSERT_EQ(run_program_with_np(4, OUTPUT_FILE_P2P, std::string(mode) + " --max-message 4093" + csv), 0);
+            ASSERT_TRUE(read_whole_file(RECORDS_FILE_CSV) == expected);
+        }
+    });
+
+    // Тест 36: слой PMPI (squirrels_counted) видит байты рассылки, и в MPI-3 (MPI_Scatterv / MPI_Iscatterv),
+    // и в MPI-4 (варианты _c): root отправляет, а процессы получают все массы и числа орехов белок
+    runner.run("Счётчики PMPI: байты рассылки посчитаны", [&]() {
+        const long long expected = static_cast<long long>(sizeof(double)) * (TOTAL_NUTS + NUM_SQUIRRELS);
+        const char* modes[] = { "", "--scatter-chunk 5000" };
+        for (const char* mode : modes) {
+            ASSERT_EQ(run_program_with_np(4, OUTPUT_FILE_COUNTED, std::string("--output summary ") + mode,
+                                          "./squirrels_counted"), 0);
+            std::ifstream fin(OUTPUT_FILE_COUNTED);
+            std::string line;
+            long long sent = 0, received = 0;
+            while (std::getline(fin, line)) {
+                std::istringstream row(line);
+                std::string routine;
+                long long calls = 0, bytes_sent = 0, bytes_recv = 0;
+                row >> routine >> calls >> bytes_sent >> bytes_recv;
+                if (routine == "MPI_Scatterv" || routine == "MPI_Scatterv_c" ||
+                    routine == "MPI_Iscatterv" || routine == "MPI_Iscatterv_c") {
+                    sent += bytes_sent;
+                    received += bytes_recv;
+                }
+            }
+            ASSERT_EQ(sent, expected);
+            ASSERT_EQ(received, expected);
+        }
+    });
+
+    // Тест 37: сводка задержек фиксированного размера: слияние частей даёт сводку целого,
+    // квантили отличаются от точных не больше чем на 4.4%, min / max / mean точные
+    runner.run("Сводка задержек: слияние и квантили", [&]() {
+        const std::size_t n = 100003;
+        std::vector<double> u(n), t(n);
+        philox_fill_nuts(11, 0, u.data(), n, 0.0, 1.0);
+        for (std::size_t i = 0; i < n; ++i) t[i] = 1e-6 * std::pow(10.0, 5.0 * u[i]); // от 1 мкс до 0.1 с
+        LatencyHist whole, merged;
+        for (double v : t) latency_hist_add(whole, v);
+        const std::size_t cuts[] = { 0, 1, 777, 50000, n };
+        for (std::size_t k = 0; k + 1 < sizeof(cuts) / sizeof(cuts[0]); ++k) {
+            LatencyHist part;
+            for (std::size_t i = cuts[k]; i < cuts[k + 1]; ++i) latency_hist_add(part, t[i]);
+            latency_hist_merge(part, merged);
+        }
+        ASSERT_EQ(merged.count, whole.count);
+        ASSERT_EQ(merged.min, whole.min);
+        ASSERT_EQ(merged.max, whole.max);
+        for (int b = 0; b < LATENCY_HIST_BINS; ++b) ASSERT_EQ(merged.bins[b], whole.bins[b]);
+
+        std::vector<double> sorted(t);
+        std::sort(sorted.begin(), sorted.end());
+        ASSERT_EQ(whole.min, sorted.front());
+        ASSERT_EQ(whole.max, sorted.back());
+        ASSERT_NEAR(whole.sum / whole.count, std::accumulate(t.begin(), t.end(), 0.0) / n, 1e-12);
+        for (double q : { 0.0, 0.01, 0.25, 0.5, 0.9, 0.99 }) {
+            double exact = sorted[std::min(n - 1, static_cast<std::size_t>(q * n))];
+            ASSERT_NEAR(latency_hist_quantile(whole, q), exact, 0.045 * exact);
+        }
+        LatencyHist empty;
+        ASSERT_EQ(latency_hist_quantile(empty, 0.5), 0.0);
+    });
+
     runner.summary();
     return runner.failed == 0 ? 0 : 1; // возврат кода завершения из main
 }
@@ -0,0 +1,220 @@
+// Тесты симуляции за один запуск mpirun. Процессы делятся MPI_Comm_split на группы разного
+// размера (при 8 процессах - 1, 2 и 5), и каждая группа прогоняет одни и те же конфигурации
+// через run_squirrels на своём коммуникаторе. Результаты проверяются в памяти, без разбора вывода:
+//   - всего орехов столько, сколько в мешке, и у каждой белки хотя бы орех (если орехов хватает);
+//   - соседки в записи белки - это средние соседних белок по кругу;
+//   - результат не зависит от числа процессов: группы сравниваются с группой из одного процесса.
+// Для каждой конфигурации печатается время в каждой группе (максимум по её процессам).
+//
+// Сборка и запуск:
+//   mpic++ -O2 -fopenmp -o tests_mpi tests_mpi.cpp squirrels.cpp
+//   mpirun --oversubscribe -np 8 ./tests_mpi
+
+#include <mpi.h>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "squirrels.hpp"
+
+// Одна конфигурация: название и параметры
+struct TestConfig {
+    std::string name;
+    Options opt;
+};
+
+// Что отличает конфигурации, кроме числа белок, орехов и зерна
+struct Variant {
+    const char* name;
+    std::function<void(Options&)> apply;
+};
+
+std::vector<TestConfig> make_configs() {
+    const std::vector<Variant> variants = {
+        { "mt19937 scatter random",        [](Options&) {} },
+        { "philox local even cart",        [](Options& o) { o.gen = "philox"; o.dist = "local"; o.partition = "even";
+                                                            o.exchange = "cart"; } },
+        { "bounded-random sendrecv",       [](Options& o) { o.partition = "bounded-random"; o.partition_cap = 1.3;
+                                                            o.exchange = "sendrecv"; } },
+        { "philox local distributed",      [](Options& o) { o.gen = "philox"; o.dist = "local";
+                                                            o.partition_mode = "distributed"; } },
+        { "scatter-chunk 777 pairwise",    [](Options& o) { o.scatter_chunk = 777; o.sum = "pairwise"; } },
+        { "shm node-size 2",               [](Options& o) { o.dist = "shm"; o.node_size = 2; } },
+        { "rounds 25",                     [](Options& o) { o.rounds = 25; } },
+        { "philox stream 500 sketch",      [](Options& o) { o.gen = "philox"; o.dist = "local"; o.stream = 500;
+                                                            o.sketch = "hist"; } },
+    };
+    const int squirrels[] = { 7, 31, 100 };
+    const long long nuts[] = { 3, 1000, 100003 };
+    std::vector<TestConfig> configs;
+    for (int sq : squirrels) {
+        for (long long n : nuts) {
+            for (const auto& v : variants) {
+                TestConfig c;
+                c.opt.num_squirrels = sq;
+                c.opt.total_nuts = n;
+                c.opt.seed = 1 + configs.size();
+                c.opt.output = "none";
+                v.apply(c.opt);
+                std::ostringstream name;
+                name << "squirrels=" << sq << " nuts=" << n << " seed=" << c.opt.seed << " " << v.name;
+                c.name = name.str();
+                configs.push_back(c);
+            }
+        }
+    }
+    return configs;
+}
+
+// Проверки собранных на root группы записей; пустая строка - всё в порядке
+std::string check_records(const Options& opt, const SquirrelsResult& result, const std::vector<SquirrelRecord>& all) {
+    const int n = opt.num_squirrels;
+    if (static_cast<int>(all.size()) != n) return "записей " + std::to_string(all.size()) + " вместо " + std::to_string(n);
+    long long total = 0;
+    for (int i = 0; i < n; ++i) {
+        const auto& r = all[i];
+        if (r.id != i) return "записи не по порядку белок";
+        if (r.nuts < (opt.total_nuts >= n ? 1 : 0)) return "белка " + std::to_string(i) + " без орехов";
+        if (r.left != all[(i - 1 + n) % n].avg || r.right != all[(i + 1) % n].avg) {
+            return "соседки белки " + std::to_string(i) + " не совпадают со средними соседних белок";
+        }
+        total += r.nuts;
+    }
+    if (total != opt.total_nuts) return "орехов " + std::to_string(total) + " вместо " + std::to_string(opt.total_nuts);
+    if (opt.sketch == "hist" && result.sketch.count != opt.total_nuts) return "в общей гистограмме не все орехи";
+    return "";
+}
+
+int main(int argc, char** argv) {
+    MPI_Init(&argc, &argv);
+    int world_size = 0, world_rank = 0;
+    MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+    MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+
+    // Группы по 1, 2, 3, ... процесса подряд; остаток достаётся последней группе
+    std::vector<int> group_firsts;
+    for (int first = 0, k = 1; first < world_size; first += k, ++k) {
+        if (first + k > world_size) break;
+        group_firsts.push_back(first);
+    }
+    int group = 0;
+    while (group + 1 < static_cast<int>(group_firsts.size()) && group_firsts[group + 1] <= world_rank) ++group;
+    MPI_Comm comm;
+    MPI_Comm_split(MPI_COMM_WORLD, group, world_rank, &comm);
+    int size = 0, rank = 0;
+    MPI_Comm_size(comm, &size);
+    MPI_Comm_rank(comm, &rank);
+    const int num_groups = static_cast<int>(group_firsts.size());
+
+    // Размеры групп - для таблицы на процессе 0
+    std::vector<int> group_sizes(num_groups);
+    for (int g = 0; g < num_groups; ++g) {
+        group_sizes[g] = (g + 1 < num_groups ? group_firsts[g + 1] : world_size) - group_firsts[g];
+    }
+
+    const auto configs = make_configs();
+    int passed = 0, failed = 0;
+    for (std::size_t c = 0; c < configs.size(); ++c) {
+        Options opt = configs[c].opt;
+        std::string err;
+        bool valid = validate_options(opt, err);
+
+        // Группа запускает конфигурацию, если у каждого её процесса будет хотя бы одна белка
+        bool runs = valid && opt.num_squirrels >= size;
+        SquirrelsResult result;
+        double seconds = 0.0;
+        if (runs) {
+            MPI_Barrier(comm);
+            double t0 = MPI_Wtime();
+            result = run_squirrels(comm, opt);
+            double local = MPI_Wtime() - t0;
+            MPI_Reduce(&local, &seconds, 1, MPI_DOUBLE, MPI_MAX, 0, comm);
+        }
+
+        // Записи всех белок группы - на её root
+        std::vector<SquirrelRecord> all;
+        std::string problem = valid ? "" : "некорректная конфигурация: " + err;
+        if (runs) {
+            int bytes = static_cast<int>(result.records.size() * sizeof(SquirrelRecord));
+            std::vector<int> counts(rank == 0 ? size : 0), displs(counts.size(), 0);
+            MPI_Gather(&bytes, 1, MPI_INT, counts.data(), 1, MPI_INT, 0, comm);
+            for (std::size_t r = 1; r < counts.size(); ++r) displs[r] = displs[r - 1] + counts[r - 1];
+            if (rank == 0) all.resize((displs.back() + counts.back()) / sizeof(SquirrelRecord));
+            MPI_Gatherv(result.records.data(), bytes, MPI_BYTE, all.data(), counts.data(), displs.data(), MPI_BYTE,
+                        0, comm);
+            int status = 0;
+            MPI_Reduce(&result.status, &status, 1, MPI_INT, MPI_MAX, 0, comm);
+            if (rank == 0) problem = (status != 0) ? "run_squirrels вернул " + std::to_string(status)
+                                                   : check_records(opt, result, all);
+        }
+
+        // Root групп отправляют итоги процессу 0 (он же root группы из одного процесса)
+        if (rank == 0 && world_rank != 0) {
+            double head[3] = { runs ? 1.0 : 0.0, seconds, static_cast<double>(all.size()) };
+            MPI_Send(head, 3, MPI_DOUBLE, 0, 0, MPI_COMM_WORLD);
+            MPI_Send(all.data(), static_cast<int>(all.size() * sizeof(SquirrelRecord)), MPI_BYTE, 0, 1, MPI_COMM_WORLD);
+            int len = static_cast<int>(problem.size());
+            MPI_Send(&len, 1, MPI_INT, 0, 2, MPI_COMM_WORLD);
+            MPI_Send(problem.data(), len, MPI_CHAR, 0, 3, MPI_COMM_WORLD);
+        }
+        if (world_rank == 0) {
+            std::ostringstream line;
+            line << std::fixed << std::setprecision(4);
+            std::vector<std::string> problems;
+            if (!problem.empty()) problems.push_back("np=1: " + problem);
+            for (int g = 0; g < num_groups; ++g) {
+                std::vector<SquirrelRecord> other;
+                double head[3] = { runs ? 1.0 : 0.0, seconds, 0.0 };
+                std::string other_problem = problem;
+                if (g > 0) {
+                    int src = group_firsts[g];
+                    MPI_Recv(head, 3, MPI_DOUBLE, src, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+                    other.resize(static_cast<std::size_t>(head[2]));
+                    MPI_Recv(other.data(), static_cast<int>(other.size() * sizeof(SquirrelRecord)), MPI_BYTE, src, 1,
+                             MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+                    int len = 0;
+                    MPI_Recv(&len, 1, MPI_INT, src, 2, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+                    other_problem.assign(static_cast<std::size_t>(len), ' ');
+                    MPI_Recv(&other_problem[0], len, MPI_CHAR, src, 3, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+                    std::string np = "np=" + std::to_string(group_sizes[g]) + ": ";
+                    if (!other_problem.empty()) problems.push_back(np + other_problem);
+                    // с одним процессом сравниваем числа орехов точно, средние - до погрешности суммирования
+                    if (head[0] != 0.0 && runs && other_problem.empty() && problem.empty()) {
+                        for (std::size_t i = 0; i < all.size(); ++i) {
+                            if (other[i].nuts != all[i].nuts || std::fabs(other[i].avg - all[i].avg) > 1e-12) {
+                                problems.push_back(np + "белка " + std::to_string(i) + " не как при np=1");
+                                break;
+                            }
+                        }
+                    }
+                }
+                line << (g ? ", " : ": ") << "np=" << group_sizes[g] << " ";
+                if (head[0] != 0.0) line << head[1] << " s";
+                else line << "-";
+            }
+            if (problems.empty()) {
+                ++passed;
+                std::cout << "[ OK ] " << configs[c].name << line.str() << std::endl;
+            } else {
+                ++failed;
+                std::cout << "[FAIL] " << configs[c].name << line.str() << std::endl;
+                for (const auto& p : problems) std::cout << "       " << p << std::endl;
+            }
+        }
+    }
+
+    if (world_rank == 0) {
+        std::cout << "\n=== TEST SUMMARY ===\n"
+                  << "Passed: " << passed << "\n"
+                  << "Failed: " << failed << std::endl;
+    }
+    MPI_Bcast(&failed, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Comm_free(&comm);
+    MPI_Finalize();
+    return failed == 0 ? 0 : 1;
+}